@@ -1433,6 +1433,26 @@ class Object(dict):
         """
         self.parent.app.clearObject(self.ref)
 
+    def reserve(self, count, typename="vertices"):
+        """
+        Allocate space for data to be loaded into this object
+
+        Loading large data in chunks is faster when the total size is known in advance,
+        any unused space is released when the object is next rendered
+
+        Parameters
+        ----------
+        count : int
+            Number of items to allocate space for (eg: vertices, not floats)
+        typename : str
+            Either a built in type: (vertices/normals/vectors/indices/colours/texcoords/luminance/rgb)
+            or a user defined data label for values
+        """
+        if typename in datatypes and typename != "values":
+            self.parent.app.reserveData(self.ref, count, datatypes[typename])
+        else:
+            self.parent.app.reserveValues(self.ref, count, typename)
+
     def cleardata(self, typename=""):
         """
         Clear specific visualisation data/values from this object
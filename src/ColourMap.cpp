@@ -419,6 +419,7 @@ void ColourMap::calibrate(float min, float max)
   //  std::cout << " colour " << colours[i].colour << " value " << colours[i].value << " pos " << colours[i].position << std::endl;
 
   calibrated = true;
+  version++;
 }
 
 //Calibration from set "range" property or geom data set
@@ -467,6 +468,37 @@ Colour ColourMap::getfast(float value)
   return precalc[c];
 }
 
+void ColourMap::colourise(const float* values, unsigned int n, Colour* out)
+{
+  //Batch version of getfast(), processed in blocks:
+  //values are scaled to precalc table indices in simple loops the compiler can vectorise,
+  //then the colours are gathered from the table
+  const unsigned int BLOCK = 256;
+  int idx[BLOCK];
+  int last = samples - 1;
+  float scale = (samples-1) * irange;
+  for (unsigned int b=0; b<n; b+=BLOCK)
+  {
+    unsigned int count = std::min(BLOCK, n-b);
+    const float* v = values + b;
+    if (log)
+    {
+      float lmin = LOG10(minimum);
+      for (unsigned int i=0; i<count; i++)
+        idx[i] = (int)(scale * (LOG10(v[i]) - lmin));
+    }
+    else
+    {
+      for (unsigned int i=0; i<count; i++)
+        idx[i] = (int)(scale * (v[i] - minimum));
+    }
+    for (unsigned int i=0; i<count; i++)
+      idx[i] = idx[i] > last ? last : (idx[i] < 0 ? 0 : idx[i]);
+    for (unsigned int i=0; i<count; i++)
+      out[b+i] = precalc[idx[i]];
+  }
+}
+
 Colour ColourMap::get(float value)
 {
   return getFromScaled(scaleValue(value));
@@ -91,6 +91,7 @@ public:
   float minimum = 0.0;
   float maximum = 1.0;
   bool calibrated = false;
+  unsigned int version = 0; //Incremented on calibration
   bool opaque = true;
   ImageLoader* texture = NULL;
 
@@ -114,6 +115,7 @@ public:
   void calibrate(Range* dataRange=NULL);
   float scalefast(float value);
   Colour getfast(float value);
+  void colourise(const float* values, unsigned int n, Colour* out);
   Colour get(float value);
   float scaleValue(float value);
   Colour getFromScaled(float scaledValue);
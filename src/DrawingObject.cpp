@@ -186,6 +186,7 @@ void DrawingObject::setup()
   //The cache stores filter values so we can avoid
   //hitting the json store for every vertex (very slow)
   filterCache.clear();
+  filterStamp++;
   json filters = properties["filters"];
   for (unsigned int i=0; i < filters.size(); i++)
   {
@@ -220,6 +221,57 @@ void DrawingObject::setup()
   radius_default = properties["radius"];
 }
 
+void DrawingObject::compile()
+{
+  //Snapshot the render properties, resolved from object, global and default values
+  props.scaling = properties["scaling"];
+  props.scaleshapes = properties["scaleshapes"];
+  props.scalepoints = properties["scalepoints"];
+  props.scalelines = properties["scalelines"];
+  props.scalevectors = properties["scalevectors"];
+  props.pointsize = properties["pointsize"];
+  props.linewidth = properties["linewidth"];
+  props.thickness = properties["thickness"];
+  props.arrowhead = properties["arrowhead"];
+  props.normalise = properties["normalise"];
+  props.length = properties["length"];
+  props.limit = properties["limit"];
+  props.alpha = properties["alpha"];
+  props.brightness = properties["brightness"];
+  props.contrast = properties["contrast"];
+  props.saturation = properties["saturation"];
+  props.ambient = properties["ambient"];
+  props.diffuse = properties["diffuse"];
+  props.specular = properties["specular"];
+  props.shininess = properties["shininess"];
+  props.pointtype = properties["pointtype"];
+  props.glyphs = properties["glyphs"];
+  props.haspointtype = properties.has("pointtype");
+  props.haslit = properties.has("lit");
+  props.hasopacity = properties.has("opacity");
+  props.hascolour = properties.has("colour");
+  props.lit = properties["lit"];
+  props.flat = properties["flat"];
+  props.tubes = properties["tubes"];
+  props.cullface = properties["cullface"];
+  props.wireframe = properties["wireframe"];
+  props.depthwrite = properties["depthwrite"];
+  props.opaque = properties["opaque"];
+  props.upscalelines = properties["upscalelines"];
+  props.autoscale = properties["autoscale"];
+  props.link = properties["link"];
+  props.loop = properties["loop"];
+  props.stamp = session.stamp;
+}
+
+const RenderProperties& DrawingObject::compiled()
+{
+  //Recompile if any properties may have changed since last compiled
+  if (props.stamp != session.stamp)
+    compile();
+  return props;
+}
+
 TextureData* DrawingObject::useTexture(Texture_Ptr tex)
 {
   GL_Error_Check;
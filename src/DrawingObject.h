@@ -43,6 +43,20 @@
 
 typedef std::shared_ptr<ImageLoader> Texture_Ptr;
 
+//Compiled snapshot of the properties used while rendering,
+//avoids json lookups and conversions in per-vertex/per-draw loops
+struct RenderProperties
+{
+  unsigned int stamp = 0; //Session property stamp when compiled
+  float scaling, scaleshapes, scalepoints, scalelines, scalevectors;
+  float pointsize, linewidth, thickness, arrowhead, normalise, length, limit;
+  float alpha, brightness, contrast, saturation, ambient, diffuse, specular, shininess;
+  int pointtype, glyphs;
+  bool haspointtype, haslit, hasopacity, hascolour;
+  bool lit, flat, tubes, cullface, wireframe, depthwrite, opaque;
+  bool upscalelines, autoscale, link, loop;
+};
+
 //Holds parameters for a drawing object
 class DrawingObject
 {
@@ -65,6 +79,8 @@ public:
   ColourMap* opacityMap;
   ColourMap* textureMap;
   std::vector<Filter> filterCache;
+  unsigned int filterStamp = 0; //Incremented when filter cache rebuilt
+  RenderProperties props; //Use compiled() to access
 
   //Data min/max values
   std::map<std::string, Range> ranges;
@@ -83,6 +99,8 @@ public:
   void updateRange(const std::string& label, const Range& newRange);
   ColourMap* getColourMap(const std::string propname="colourmap", ColourMap* current=NULL);
   void setup();
+  void compile();
+  const RenderProperties& compiled();
   TextureData* useTexture(Texture_Ptr tex=nullptr);
   std::string name() {return properties["name"];}
 };
@@ -59,11 +59,11 @@ void GeomData::checkPointMinMax(float *coord)
   compareCoordMinMax(min, max, coord);
 }
 
-void GeomData::calcBounds()
+void GeomData::calcBounds(int threads)
 {
-  //Loop through vertices and calculate bounds automatically for all elements
-  for (unsigned int j=0; j < count(); j++)
-    checkPointMinMax(render->vertices[j]);
+  //Calculate bounds automatically for all elements
+  if (count() == 0) return;
+  minmaxReduce(render->vertices[0], count(), 3, min, max, threads);
 }
 
 void GeomData::label(const std::string& labeltext)
@@ -289,6 +289,66 @@ void ColourLookupLuminanceOpacityMapped::operator()(Colour& colour, unsigned int
   colour.a = temp.a * draw->opacity;
 }
 
+void ColourLookup::colourise(Colour* colours, unsigned int start, unsigned int count) const
+{
+  //Default batch lookup, one colour at a time
+  for (unsigned int i=0; i<count; i++)
+    (*this)(colours[i], start+i);
+}
+
+//Batch lookup of mapped colours from value data, returns count of colours mapped,
+//any further indices beyond the end of the data are left for the caller
+static unsigned int colouriseMapped(ColourMap* cmap, FloatValues* vals, Colour* colours, unsigned int start, unsigned int count, bool nulls=false)
+{
+  unsigned int size = vals->size();
+  unsigned int n = start < size ? std::min(count, size - start) : 0;
+  if (n == 0) return 0;
+  cmap->colourise((float*)vals->ref(start), n, colours);
+  //Clear colours of null values
+  if (nulls)
+  {
+    for (unsigned int i=0; i<n; i++)
+      if ((*vals)[start+i] == HUGE_VAL)
+        colours[i].value = 0;
+  }
+  return n;
+}
+
+void ColourLookupMapped::colourise(Colour* colours, unsigned int start, unsigned int count) const
+{
+  unsigned int n = colouriseMapped(draw->colourMap, vals, colours, start, count, true);
+  for (unsigned int i=0; i<n; i++)
+    colours[i].a *= draw->opacity;
+  for (unsigned int i=n; i<count; i++)
+    (*this)(colours[i], start+i);
+}
+
+void ColourLookupOpacityMapped::colourise(Colour* colours, unsigned int start, unsigned int count) const
+{
+  //Set opacity using own value map...
+  std::vector<Colour> temp(count);
+  unsigned int n = colouriseMapped(draw->opacityMap, ovals, temp.data(), start, count);
+  for (unsigned int i=0; i<n; i++)
+  {
+    colours[i] = draw->colour;
+    colours[i].a *= div255 * temp[i].a * draw->opacity;
+  }
+  for (unsigned int i=n; i<count; i++)
+    (*this)(colours[i], start+i);
+}
+
+void ColourLookupMappedOpacityMapped::colourise(Colour* colours, unsigned int start, unsigned int count) const
+{
+  unsigned int n = colouriseMapped(draw->colourMap, vals, colours, start, count, true);
+  //Set opacity using own value map...
+  std::vector<Colour> temp(n);
+  n = colouriseMapped(draw->opacityMap, ovals, temp.data(), start, n);
+  for (unsigned int i=0; i<n; i++)
+    colours[i].a *= div255 * temp[i].a * draw->opacity;
+  for (unsigned int i=n; i<count; i++)
+    (*this)(colours[i], start+i);
+}
+
 int GeomData::colourCount()
 {
   //Return number of colour values or RGBA colours
@@ -514,91 +574,146 @@ unsigned int GeomData::valuesLookup(const json& by)
 }
 
 //Returns true if vertex/voxel is to be filtered (don't display)
-bool GeomData::filter(unsigned int idx)
-{
-  //Iterate all the filters,
-  // - if a value matches a filter condition return true (filtered)
-  // - if no filters hit, returns false
-  float value, min, max;
-  int size, range;
-  unsigned int ridx;
-  for (unsigned int i=0; i < draw->filterCache.size(); i++)
-  {
-    if (values.size() <= draw->filterCache[i].dataIdx || !values[draw->filterCache[i].dataIdx]) continue;
-    size = values[draw->filterCache[i].dataIdx]->size();
-    if (draw->filterCache[i].dataIdx < MAX_DATA_ARRAYS && size > 0)
+void GeomData::filterCalibrate()
+{
+  //Evaluate all the filters into the cached mask,
+  //skipped if none of the filter settings or data have changed since last evaluated
+  filterStamp = draw->filterStamp;
+  unsigned int N = count();
+  std::vector<double> inputs = {(double)N};
+  for (auto& f : draw->filterCache)
+  {
+    inputs.insert(inputs.end(), {(double)f.dataIdx, f.minimum, f.maximum, (double)f.map, (double)f.out, (double)f.inclusive});
+    if (values.size() <= f.dataIdx || !values[f.dataIdx]) continue;
+    Values_Ptr v = values[f.dataIdx];
+    inputs.insert(inputs.end(), {(double)(uintptr_t)v.get(), (double)v->size(), (double)v->version});
+    if (f.map && draw->colourMap)
+      inputs.insert(inputs.end(), {(double)(uintptr_t)draw->colourMap, (double)draw->colourMap->version});
+    else if (f.map)
+      inputs.insert(inputs.end(), {draw->ranges[v->label].minimum, draw->ranges[v->label].maximum});
+  }
+  if (filterMask.size() == (N + 63) / 64 && inputs == filterInputs) return;
+  filterInputs = inputs;
+
+  //Filter flags per vertex, combined from each filter
+  std::vector<unsigned char> hit(N);
+  std::vector<unsigned char> flags;
+  std::vector<float> scaled;
+  for (auto& f : draw->filterCache)
+  {
+    if (values.size() <= f.dataIdx || !values[f.dataIdx]) continue;
+    Values_Ptr v = values[f.dataIdx];
+    unsigned int size = v->size();
+    if (f.dataIdx >= MAX_DATA_ARRAYS || size == 0) continue;
+
+    float min = f.minimum;
+    float max = f.maximum;
+    const float* data = v->value.data();
+    if (f.map)
     {
-      //Have values but not enough for per-vertex? spread over range (eg: per triangle)
-      range = count() / size;
-      ridx = idx;
-      if (range > 1) ridx = idx / range;
-
-      //if (idx%1000==0) std::cout << "Filtering on index: " << draw->filterCache[i].dataIdx << " " << size << " values" << std::endl;
-      min = draw->filterCache[i].minimum;
-      max = draw->filterCache[i].maximum;
-      Values_Ptr v = values[draw->filterCache[i].dataIdx];
-      if (draw->filterCache[i].map)
+      //Range type filters map over available values on [0,1] => [min,max]
+      //If a colourmap is provided, that is used to get the values (allows log maps)
+      //Otherwise they come directly from the data 
+      ColourMap* cmap = draw->colourMap;
+      if (cmap)
       {
-        //Range type filters map over available values on [0,1] => [min,max]
-        //If a colourmap is provided, that is used to get the values (allows log maps)
-        //Otherwise they come directly from the data 
-        ColourMap* cmap = draw->colourMap;
-        if (cmap)
-          value = cmap->scaleValue((*v)[ridx]);
-        else if (v != nullptr)
-        {
-          auto range = draw->ranges[v->label];
-          value = range.maximum - range.minimum;
-          min = range.minimum + min * value;
-          max = range.minimum + max * value;
-          value = (*v)[ridx];
-        }
+        scaled.resize(size);
+        for (unsigned int j=0; j<size; j++)
+          scaled[j] = cmap->scaleValue(data[j]);
+        data = scaled.data();
       }
       else
-        value = (*v)[ridx];
-
-      //Always filter nan/inf
-      if (std::isnan(value) || std::isinf(value)) return true;
-
-      //if (idx%10000==0) std::cout << min << " < " << value << " < " << max << std::endl;
-      //std::cout << min << " < " << value << " < " << max << std::endl;
-      
-      //"out" flag indicates values between the filter range are skipped - exclude
-      if (draw->filterCache[i].out)
       {
-        //- return TRUE if VALUE inside RANGE
-        if (min == max)
-        {
-          if (min == value)
-            return true;
-          continue;
-        }
-        //Filters out values between specified ranges (allows filtering separate sections)
-        if (draw->filterCache[i].inclusive && value >= min && value <= max)
-          return true;
-        if (value > min && value < max) 
-          return true;
+        auto range = draw->ranges[v->label];
+        float value = range.maximum - range.minimum;
+        min = range.minimum + min * value;
+        max = range.minimum + max * value;
       }
+    }
+
+    //Branch free tests of each value, always filter nan/inf
+    flags.resize(size);
+    if (f.out)
+    {
+      //"out" flag indicates values between the filter range are skipped - exclude
+      if (min == max)
+        for (unsigned int j=0; j<size; j++)
+          flags[j] = (!(fabsf(data[j]) <= FLT_MAX)) | (data[j] == min);
+      //Filters out values between specified ranges (allows filtering separate sections)
+      else if (f.inclusive)
+        for (unsigned int j=0; j<size; j++)
+          flags[j] = (!(fabsf(data[j]) <= FLT_MAX)) | ((data[j] >= min) & (data[j] <= max));
+      else
+        for (unsigned int j=0; j<size; j++)
+          flags[j] = (!(fabsf(data[j]) <= FLT_MAX)) | ((data[j] > min) & (data[j] < max));
+    }
+    else
+    {
       //Default is to filter values NOT in the filter range - include those that are
+      if (min == max)
+        for (unsigned int j=0; j<size; j++)
+          flags[j] = (!(fabsf(data[j]) <= FLT_MAX)) | (data[j] != min);
+      //Filters out values not between specified ranges (allows combining filters)
       else
+        for (unsigned int j=0; j<size; j++)
+          flags[j] = (!(fabsf(data[j]) <= FLT_MAX)) | (data[j] <= min) | (data[j] >= max);
+    }
+
+    //Have values but not enough for per-vertex? spread over range (eg: per triangle)
+    unsigned int range = N / size;
+    if (range > 1)
+    {
+      for (unsigned int j=0; j<size; j++)
+        for (unsigned int k=j*range; k<(j+1)*range; k++)
+          hit[k] |= flags[j];
+    }
+    else
+    {
+      for (unsigned int k=0; k<N && k<size; k++)
+        hit[k] |= flags[k];
+    }
+  }
+
+  //Pack into the mask
+  filterMask.assign((N + 63) / 64, 0);
+  for (unsigned int k=0; k<N; k++)
+    filterMask[k >> 6] |= (uint64_t)hit[k] << (k & 63);
+}
+
+bool GeomData::filter(unsigned int idx)
+{
+  //Returns true if vertex is filtered out by any of the filters
+  //(mask also re-evaluated if vertices were added since, without a new setup)
+  unsigned int N = count();
+  if (filterStamp != draw->filterStamp || filterMask.size() != (N + 63) / 64)
+    filterCalibrate();
+  if (idx >= N) return false;
+  return (filterMask[idx >> 6] >> (idx & 63)) & 1;
+}
+
+unsigned int GeomData::unfiltered(unsigned int idx)
+{
+  //Returns the first vertex from idx not filtered out, or count() if none
+  unsigned int N = count();
+  if (draw->filterCache.size() == 0) return std::min(idx, N);
+  if (filterStamp != draw->filterStamp || filterMask.size() != (N + 63) / 64)
+    filterCalibrate();
+  while (idx < N)
+  {
+    //Skip whole words of filtered vertices
+    uint64_t word = ~filterMask[idx >> 6] >> (idx & 63);
+    if (word)
+    {
+      while (!(word & 1))
       {
-        //- return TRUE if VALUE outside RANGE
-        if (min == max)
-        {
-          if (min != value)
-            return true;
-          continue;
-        }
-        //Filters out values not between specified ranges (allows combining filters)
-        if (draw->filterCache[i].inclusive && (value < min || value > max))
-          return true;
-        if (value <= min || value >= max)
-          return true;
+        word >>= 1;
+        idx++;
       }
+      return std::min(idx, N);
     }
+    idx = (idx | 63) + 1;
   }
-  //std::cout << "(Not filtered)\n";
-  return false;
+  return N;
 }
 
 FloatValues* GeomData::colourData()
@@ -699,16 +814,22 @@ void Geometry::clear(bool fixed)
   if (fixed)
   {
     records.clear();
+    //Drop the pools, the old slabs are released together when no longer referenced
+    pools.clear();
   }
   else
   {
-    for (int i = records.size()-1; i>=0; i--)
+    //Now using shared_ptr so no need to delete
+    records.erase(std::remove_if(records.begin(), records.end(),
+                                 [](const Geom_Ptr& g) {return g->step >= 0 && g->type != lucTracerType;}),
+                  records.end());
+    //Drop the step pools (retained tracer records keep theirs referenced)
+    for (auto it = pools.begin(); it != pools.end(); )
     {
-      if (records[i]->step >= 0 && records[i]->type != lucTracerType)
-      {
-        //Now using shared_ptr so no need to delete
-        records.erase(records.begin()+i);
-      }
+      if (it->first >= 0)
+        it = pools.erase(it);
+      else
+        ++it;
     }
   }
   
@@ -718,18 +839,25 @@ void Geometry::clear(bool fixed)
   geom.clear();
 }
 
+void Geometry::clearStep(int step)
+{
+  //Remove data loaded at a single timestep (fixed and tracer data retained)
+  if (step < 0) return;
+  records.erase(std::remove_if(records.begin(), records.end(),
+                               [step](const Geom_Ptr& g) {return g->step == step && g->type != lucTracerType;}),
+                records.end());
+  //The step's slabs are released together once no longer referenced
+  pools.erase(step);
+}
+
 void Geometry::remove(DrawingObject* draw)
 {
   //Same as clear but for specific drawing object
   reload = true;
-  for (int i = records.size()-1; i>=0; i--)
-  {
-    if (draw == records[i]->draw)
-    {
-      //Now using shared_ptr so no need to delete
-      records.erase(records.begin()+i);
-    }
-  }
+  //Now using shared_ptr so no need to delete
+  records.erase(std::remove_if(records.begin(), records.end(),
+                               [draw](const Geom_Ptr& g) {return g->draw == draw;}),
+                records.end());
 
   //Ensure temporal data gets reloaded
   geom.clear();
@@ -1035,141 +1163,144 @@ void Geometry::merge(int start, int end)
   int fixedVertices = 0;
 
   std::vector<Geom_Ptr> fixed;
-  
-  //First locate fixed records
+  //Positions of fixed records for each drawing object
+  std::map<DrawingObject*, std::vector<unsigned int>> fixedIndex;
+  //Records in range for each step, avoids scanning all records for every step
+  std::map<int, std::vector<Geom_Ptr>> stepRecords;
+
+  //First locate fixed records, and index the variable records by step
   for (unsigned int i=0; i<records.size(); i++)
   {
     //printf("STEP %d (%d - %d)\n", records[i]->step, start, end);
     if (records[i]->step == -1)
     {
+      fixedIndex[records[i]->draw].push_back(fixed.size());
       fixed.push_back(records[i]);
       //printf("%d (%s) Found fixed record for %s, complete? %d\n", i, GeomData::names[type].c_str(),
       //       records[i]->draw->name().c_str(), records[i]->count() > 0);
 
       fixedVertices += records[i]->count();
     }
+    else if (records[i]->step >= 0 && records[i]->step >= start && records[i]->step <= end)
+    {
+      stepRecords[records[i]->step].push_back(records[i]);
+    }
   }
 
   allDataFixed = true;
 
   //Now process each step in turn
-  for (int step=start; step<=end; step++)
+  for (auto& stepRecord : stepRecords)
   {
-    for (unsigned int i=0; i<records.size(); i++)
+    for (auto record : stepRecord.second)
     {
-      if (step >= 0 && records[i]->step == step)
+      allDataFixed = false;
+      //Three possible cases:
+      //- Data is complete:
+      //  - check previous loaded record with same drawing object
+      //    - Not incomplete? Load as completely variable
+      //    - Found incomplete? Load and merge with incomplete fixed data
+      //- Data is incomplete:
+      //  - Find previous loaded record for same drawing object
+      //    Merge with the fixed record
+
+      //Find the previous record with this object in the fixed list
+      Geom_Ptr merge_source = nullptr;
+      Geom_Ptr merge_dest = nullptr;
+      auto found = fixedIndex.find(record->draw);
+      if (found != fixedIndex.end() && found->second.size())
       {
-        allDataFixed = false;
-        //Three possible cases:
-        //- Data is complete:
-        //  - check previous loaded record with same drawing object
-        //    - Not incomplete? Load as completely variable
-        //    - Found incomplete? Load and merge with incomplete fixed data
-        //- Data is incomplete:
-        //  - Find previous loaded record for same drawing object
-        //    Merge with the fixed record
-
-        //Find the previous record with this object in the fixed list
-        int pos = -1;
-        Geom_Ptr merge_source = nullptr;
-        Geom_Ptr merge_dest = nullptr;
-        for (pos=fixed.size()-1; pos>=0; pos--)
+        unsigned int pos = found->second.back();
+        //Vertices in fixed?
+        if (fixed[pos]->count() > 0)
         {
-          if (fixed[pos]->draw == records[i]->draw)
-          {
-            //Vertices in fixed?
-            if (fixed[pos]->count() > 0)
-            {
-              merge_dest = fixed[pos];
-              merge_source = records[i];
-              //printf("%d (%s) BASE: Added fixed record for %s, complete? %d\n", i, GeomData::names[type].c_str(),
-              //       fixed[pos]->draw->name().c_str(), fixed[pos]->count() > 0);
-              //Use fixed entry as base, copy its reference
-              geom.push_back(fixed[pos]);
-            }
-            else
-            {
-              //Use as source and copy records to varying entry
-              merge_source = fixed[pos];
-              //printf(" - SET SOURCE %s %d\n", fixed[pos]->draw->name().c_str(), pos);
-            }
-
-            //Erase from fixed list
-            fixed.erase(fixed.begin()+pos);
-            break;
-          }
+          merge_dest = fixed[pos];
+          merge_source = record;
+          //Use fixed entry as base, copy its reference
+          geom.push_back(fixed[pos]);
         }
-        
-        //Vertices in varying? (Or no fixed record to merge with)
-        if (records[i]->count() > 0 || !merge_dest)
+        else
         {
-          //Use time-varying entry as base, copy its reference
-          geom.push_back(records[i]);
-          //printf("%d (%s) BASE: Added variable record for %s, complete? %d\n", i, GeomData::names[type].c_str(),
-          //       records[i]->draw->name().c_str(), records[i]->count() > 0);
-          //printf("%d/%d Copy record @ %d for %s, complete? %d\n", i, pos, step, records[i]->draw->name().c_str(), records[i]->count() > 0);
-          merge_dest = records[i];
+          //Use as source and copy records to varying entry
+          merge_source = fixed[pos];
         }
 
-        if (merge_source && merge_dest)
-        {
+        //Remove from fixed list
+        found->second.pop_back();
+        fixed[pos] = nullptr;
+      }
+      
+      //Vertices in varying? (Or no fixed record to merge with)
+      if (record->count() > 0 || !merge_dest)
+      {
+        //Use time-varying entry as base, copy its reference
+        geom.push_back(record);
+        //printf("(%s) BASE: Added variable record for %s, complete? %d\n", GeomData::names[type].c_str(),
+        //       record->draw->name().c_str(), record->count() > 0);
+        //printf("Copy record @ %d for %s, complete? %d\n", stepRecord.first, record->draw->name().c_str(), record->count() > 0);
+        merge_dest = record;
+      }
 
-          //Merge with previous entry
-          //printf("%d/%d Merging record @ %d for %s, complete? %d/%d\n", i, pos, step, merge_source->draw->name().c_str(),
-          //       merge_source->count() > 0, merge_dest->count() > 0);
-          for (auto vals : merge_source->values)
+      if (merge_source && merge_dest)
+      {
+
+        //Merge with previous entry
+        //printf("Merging record @ %d for %s, complete? %d/%d\n", stepRecord.first, merge_source->draw->name().c_str(),
+        //       merge_source->count() > 0, merge_dest->count() > 0);
+        for (auto vals : merge_source->values)
+        {
+          //Only insert if not already done
+          json by = vals->label;
+          std::string labl = by;
+          unsigned int idx = merge_dest->valuesLookup(by);
+          if (idx <= MAX_DATA_ARRAYS)
           {
-            //Only insert if not already done
-            json by = vals->label;
-            std::string labl = by;
-            unsigned int idx = merge_dest->valuesLookup(by);
-            if (idx <= MAX_DATA_ARRAYS)
-            {
-              //Replace
-              //printf(" - REPLACE %s\n", labl.c_str());
-              merge_dest->values[idx] = vals;
-            }
-            else
-            {
-              //Append (none existing)
-              //printf(" - APPEND %s\n", labl.c_str());
-              merge_dest->values.push_back(vals);
-            }
+            //Replace
+            //printf(" - REPLACE %s\n", labl.c_str());
+            merge_dest->values[idx] = vals;
+          }
+          else
+          {
+            //Append (none existing)
+            //printf(" - APPEND %s\n", labl.c_str());
+            merge_dest->values.push_back(vals);
           }
-
-          //Copy hard coded render data types
-          // - data in source always overwrites data in dest if present
-          if (merge_source->_vertices->size() > 0)
-            merge_dest->_vertices = merge_source->_vertices;
-          if (merge_source->_normals->size() > 0)
-            merge_dest->_normals = merge_source->_normals;
-          if (merge_source->_vectors->size() > 0)
-            merge_dest->_vectors = merge_source->_vectors;
-          if (merge_source->_indices->size() > 0)
-            merge_dest->_indices = merge_source->_indices;
-          if (merge_source->_colours->size() > 0)
-            merge_dest->_colours = merge_source->_colours;
-          if (merge_source->_texCoords->size() > 0)
-            merge_dest->_texCoords = merge_source->_texCoords;
-          if (merge_source->_luminance->size() > 0)
-            merge_dest->_luminance = merge_source->_luminance;
-          if (merge_source->_rgb->size() > 0)
-            merge_dest->_rgb = merge_source->_rgb;
-
-          //Update references in render container
-          merge_dest->setRenderData();
-
-          //Copy dimensions and texture if none set in dest record
-          if (!merge_dest->width)
-            merge_dest->width = merge_source->width;
-          if (!merge_dest->height)
-            merge_dest->height = merge_source->height;
-          if (!merge_dest->depth)
-            merge_dest->depth = merge_source->depth;
-          if (!merge_dest->texture)
-            merge_dest->texture = merge_source->texture;
         }
 
+        //Copy hard coded render data types
+        // - data in source always overwrites data in dest if present
+        if (merge_source->_vertices->size() > 0)
+          merge_dest->_vertices = merge_source->_vertices;
+        if (merge_source->_normals->size() > 0)
+          merge_dest->_normals = merge_source->_normals;
+        if (merge_source->_vectors->size() > 0)
+          merge_dest->_vectors = merge_source->_vectors;
+        if (merge_source->_indices->size() > 0)
+          merge_dest->_indices = merge_source->_indices;
+        if (merge_source->_colours->size() > 0)
+          merge_dest->_colours = merge_source->_colours;
+        if (merge_source->_texCoords->size() > 0)
+          merge_dest->_texCoords = merge_source->_texCoords;
+        if (merge_source->_luminance->size() > 0)
+          merge_dest->_luminance = merge_source->_luminance;
+        if (merge_source->_rgb->size() > 0)
+          merge_dest->_rgb = merge_source->_rgb;
+
+        //Update references in render container
+        merge_dest->setRenderData();
+        //Free replaced dest data, source data now used by dest is kept
+        merge_source->shareStore(*merge_dest);
+        merge_dest->releaseStore();
+
+        //Copy dimensions and texture if none set in dest record
+        if (!merge_dest->width)
+          merge_dest->width = merge_source->width;
+        if (!merge_dest->height)
+          merge_dest->height = merge_source->height;
+        if (!merge_dest->depth)
+          merge_dest->depth = merge_source->depth;
+        if (!merge_dest->texture)
+          merge_dest->texture = merge_source->texture;
       }
     }
   }
@@ -1177,6 +1308,7 @@ void Geometry::merge(int start, int end)
   //Add any remaining fixed entries
   for (auto f : fixed)
   {
+    if (!f) continue;
     //printf("(%s) FIXED: Added fixed record for %s, complete? %d\n", GeomData::names[type].c_str(),
     //       f->draw->name().c_str(), f->count() > 0);
     geom.push_back(f);
@@ -1313,15 +1445,16 @@ void Geometry::setState(Geom_Ptr g)
   //Only set rest of object state when object changes
   if (draw == cached) return;
   cached = draw;
+  const RenderProperties& cprops = draw->compiled();
 
   //printf("SETSTATE %s TEXTURE %p\n", g->draw->name().c_str(), texture);
-  bool lighting = props["lit"];
+  bool lighting = cprops.lit;
   //Don't light surfaces in 2d models
   if ((type == lucTriangleType || type == lucGridType) && !view->is3d && !internal)
     lighting = false;
 
   //Global/Local draw state
-  if (props["cullface"])
+  if (cprops.cullface)
     glEnable(GL_CULL_FACE);
   else
     glDisable(GL_CULL_FACE);
@@ -1334,7 +1467,7 @@ void Geometry::setState(Geom_Ptr g)
   if (TriangleBased(type))
   {
     //Disable lighting and polygon faces in wireframe mode
-    if (props["wireframe"])
+    if (cprops.wireframe)
     {
 #ifndef GLES2
       glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
@@ -1343,22 +1476,21 @@ void Geometry::setState(Geom_Ptr g)
       glDisable(GL_CULL_FACE);
     }
     //Disable colour interpolation (flat shading)
-    flat = props["flat"];
+    flat = cprops.flat;
 
     //For line sub-rendering, disable lighting by default (unless "lit" was set)
-    if (parentType == lucLineType && !props.has("lit") && !props["tubes"])
+    if (parentType == lucLineType && !cprops.haslit && !cprops.tubes)
       lighting = false;
   }
   else
   {
     //Flat disables lighting for non surface types
-    if (props["flat"])
+    if (cprops.flat)
       lighting = false;
   }
 
   //Default line width
-  float lineWidth = (float)props["linewidth"];
-  session.context.setLineWidth(lineWidth, props["upscalelines"]);
+  session.context.setLineWidth(cprops.linewidth, cprops.upscalelines);
 
   //Disable depth test by default for 2d lines, otherwise enable
   bool depthTestDefault = (view->is3d || type != lucLineType);
@@ -1367,7 +1499,7 @@ void Geometry::setState(Geom_Ptr g)
   else
     glDisable(GL_DEPTH_TEST);
 
-  if (props["depthwrite"])
+  if (cprops.depthwrite)
     glDepthMask(GL_TRUE);
   else
     glDepthMask(GL_FALSE);
@@ -1484,14 +1616,14 @@ void Geometry::setState(Geom_Ptr g)
 
   //Per-object "opacity" overrides global default if set
   //"alpha" is multiplied to affect all objects
-  float opacity = (float)props["alpha"];
+  float opacity = cprops.alpha;
   //Apply global 'opacity' only if no per-object setting (which is applied with colour)
-  if (!props.has("opacity"))
+  if (!cprops.hasopacity)
     opacity *= (float)session.global("opacity");
   bool allopaque = session.global("opaque");
   if (allopaque) opacity = 1.0;
   prog->setUniformf("uOpacity", opacity);
-  if (props.has("colour") && !draw->colourMap && g->render->colours.size() == 0)
+  if (cprops.hascolour && !draw->colourMap && g->render->colours.size() == 0)
     prog->setUniform("uColour", draw->colour);
   else
   {
@@ -1499,13 +1631,13 @@ void Geometry::setState(Geom_Ptr g)
     prog->setUniform("uColour", clear);
   }
   prog->setUniformi("uLighting", lighting);
-  prog->setUniformf("uBrightness", props["brightness"]);
-  prog->setUniformf("uContrast", props["contrast"]);
-  prog->setUniformf("uSaturation", props["saturation"]);
-  prog->setUniformf("uAmbient", props["ambient"]);
-  prog->setUniformf("uDiffuse", props["diffuse"]);
-  prog->setUniformf("uSpecular", props["specular"]);
-  prog->setUniformf("uShininess", props["shininess"]);
+  prog->setUniformf("uBrightness", cprops.brightness);
+  prog->setUniformf("uContrast", cprops.contrast);
+  prog->setUniformf("uSaturation", cprops.saturation);
+  prog->setUniformf("uAmbient", cprops.ambient);
+  prog->setUniformf("uDiffuse", cprops.diffuse);
+  prog->setUniformf("uSpecular", cprops.specular);
+  prog->setUniformf("uShininess", cprops.shininess);
   prog->setUniform("uLightPos", props["lightpos"]);
   prog->setUniform("uLight", props["light"]);
   prog->setUniformi("uTextured", texture && texture->unit >= 0 && g->hasTexture());
@@ -1859,6 +1991,9 @@ void Geometry::display(bool refresh)
       {
         if (geom[index]->draw->name().length() == 0) continue;
 
+        //Data loaded, release any unused space
+        geom[index]->shrink();
+
         geom[index]->opaque = geom[index]->opaqueCheck();
         //printf("GEOM INDEX %d (%s)  OPAQUE? %d\n", index, geom[index]->draw->name().c_str(), geom[index]->opaque);
 
@@ -2079,7 +2214,9 @@ Geom_Ptr Geometry::add(DrawingObject* draw)
 {
   int timestep = session.now;
   if (draw->properties["fixed"]) timestep = -1;
-  Geom_Ptr geomdata = std::make_shared<GeomData>(draw, type, timestep);
+  std::shared_ptr<BlockPool>& pool = pools[timestep];
+  if (!pool) pool = std::make_shared<BlockPool>();
+  Geom_Ptr geomdata = std::allocate_shared<GeomData>(PoolAllocator<GeomData>(pool), draw, type, timestep, pool);
   geomdata->internal = internal;
   records.push_back(geomdata);
   //if (allhidden) draw->properties.data["visible"] = false;
@@ -2116,10 +2253,8 @@ void Geometry::clearBounds(DrawingObject* draw, bool allsteps)
     {
       //If no range, must calculate
       for (int i=0; i<3; i++)
-      {
         g->max[i] = -(g->min[i] = HUGE_VAL);
-        g->calcBounds();
-      }
+      g->calcBounds(session.global("threads"));
     }
   }
 }
@@ -2138,7 +2273,7 @@ void Geometry::objectBounds(DrawingObject* draw, float* min, float* max, bool al
     {
       if (std::isinf(g->max[i]) || std::isinf(g->min[i]))
       {
-        g->calcBounds();
+        g->calcBounds(session.global("threads"));
         //printf("No bounding dims provided for object %s, calculated ...%f,%f,%f - %f,%f,%f\n", g->draw->name().c_str(), 
         //        g->min[0], g->min[1], g->min[2], g->max[0], g->max[1], g->max[2]);
         break;
@@ -2231,11 +2366,14 @@ void Geometry::read(Geom_Ptr geomdata, unsigned int n, lucGeometryDataType dtype
   if (n > 0)
     geomdata->dataContainer(dtype)->read(n, data);
 
-  if (dtype == lucVertexData)
+  if (dtype == lucVertexData && data && type != lucLabelType)
   {
     //Update bounds on single vertex reads (except labels)
-    if (n == 1 && type != lucLabelType) // && !internal)
+    if (n == 1) // && !internal)
       geomdata->checkPointMinMax((float*)data);
+    //Extend existing bounds on bulk reads, otherwise calculated when required
+    else if (n > 1 && geomdata->min[0] <= geomdata->max[0])
+      minmaxReduce((float*)data, n, 3, geomdata->min, geomdata->max, session.global("threads"));
   }
 }
 
@@ -2279,6 +2417,26 @@ Geom_Ptr Geometry::read(Geom_Ptr geom, unsigned int n, const void* data, std::st
   return geom; //Return data store pointer
 }
 
+Geom_Ptr Geometry::reserve(DrawingObject* draw, unsigned int n, lucGeometryDataType dtype)
+{
+  //Allocate space for n more items in the object's data store, before reading in chunks
+  Geom_Ptr geomdata = getObjectStore(draw);
+  if (!geomdata)
+    geomdata = add(draw);
+  Data_Ptr container = geomdata->dataContainer(dtype);
+  if (container) container->reserve(n);
+  return geomdata;
+}
+
+Geom_Ptr Geometry::reserve(DrawingObject* draw, unsigned int n, std::string label)
+{
+  //Allocate space for n more values in given label - for value data only
+  Geom_Ptr geomdata = read(draw, 0, NULL, label);
+  Values_Ptr store = geomdata->valueContainer(label);
+  if (store) store->reserve(n);
+  return geomdata;
+}
+
 //Read a triangle with optional resursive splitting and y/z swap
 void Geometry::addTriangle(DrawingObject* obj, float* a, float* b, float* c, int level, bool texCoords, float trilimit, float* normal)
 {
@@ -2384,7 +2542,7 @@ void Geometry::scanDataRange(DrawingObject* draw)
           range = ranges[fvals.label];
 
         //Get local range, skip if already cached
-        fvals.minmax();
+        fvals.minmax(session.global("threads"));
 
         //Apply local element range to data range for object
         //std::cout << session.now << " *Updating data range for " << g->draw->name() << " : " 
@@ -63,21 +63,18 @@ typedef struct
 {
   unsigned short distance;
   GLuint index; //global index
-  float* vertex; //Pointer to vertex
 } PIndex;
 
 typedef struct
 {
   unsigned short distance;
   GLuint index[2]; //global indices
-  float* vertex; //Pointer to vertex to calc distance from (usually centre)
 } LIndex;
 
 typedef struct
 {
   unsigned short distance;
   GLuint index[3]; //global indices
-  float* vertex; //Pointer to vertex to calc distance from (usually centroid)
 } TIndex;
 
 template <typename T>
@@ -112,6 +109,52 @@ void radix(char byte, long N, T *source, T *dest)
   }
 }
 
+//Parallel version of radix(), below this many elements per thread the serial pass is used
+#define RADIX_MIN_CHUNK 65536
+template <typename T>
+void radix_parallel(char byte, long N, T *source, T *dest, int threads=0)
+{
+  unsigned int nt = workerThreads(threads);
+  if (nt > N / RADIX_MIN_CHUNK) nt = N / RADIX_MIN_CHUNK;
+  if (nt <= 1)
+  {
+    radix<T>(byte, N, source, dest);
+    return;
+  }
+
+  //Histogram of each thread's contiguous chunk
+  int size = sizeof(T);
+  unsigned char* src = (unsigned char*)source;
+  std::vector<long> index(nt * 256, 0);
+  parallelRange(N, nt, [&](size_t start, size_t end, unsigned int t)
+  {
+    long* count = &index[t*256];
+    for (size_t i=start; i<end; i++)
+      count[src[i*size+byte]]++;
+  });
+
+  //Offsets by value then by thread, so each thread's elements land after those
+  //of earlier chunks with the same value, giving the same stable result as radix()
+  long total = 0;
+  for (int v=0; v<256; v++)
+  {
+    for (unsigned int t=0; t<nt; t++)
+    {
+      long count = index[t*256+v];
+      index[t*256+v] = total;
+      total += count;
+    }
+  }
+
+  //Scatter, each thread writes to its own ranges
+  parallelRange(N, nt, [&](size_t start, size_t end, unsigned int t)
+  {
+    long* offset = &index[t*256];
+    for (size_t i=start; i<end; i++)
+      dest[offset[src[i*size+byte]]++] = source[i];
+  });
+}
+
 template <typename T>
 void radix_sort(T *source, T* swap, long N, char bytes)
 {
@@ -127,12 +170,24 @@ void radix_sort(T *source, T* swap, long N, char bytes)
   }
 }
 
+//Temporary sort space, one buffer per thread kept and reused by later sorts
+//(sorts of different sizes often alternate on the same thread, so only grows,
+// unless the size needed drops well below the high water mark, as in SortData)
+template <typename T>
+T* sortSwapBuffer(size_t N)
+{
+  static thread_local std::vector<T> pool;
+  if (pool.size() < N)
+    pool.resize(N);
+  else if (N < pool.size() / 4)
+    std::vector<T>(N).swap(pool);
+  return pool.data();
+}
+
 template <typename T>
 void radix_sort(T *source, long N, char bytes)
 {
-  T* temp = (T*)malloc(N*sizeof(T));
-  radix_sort(source, temp, N, bytes);
-  free(temp);
+  radix_sort(source, sortSwapBuffer<T>(N), N, bytes);
 }
 
 template <class T>
@@ -140,10 +195,20 @@ class SortData
 {
   public:
     T* buffer = NULL;
-    T* swap = NULL;
+    uint64_t* keys = NULL; //Sort keys, distance in the low 16 bits and element in the high bits
+    std::vector<unsigned short> distances; //Element distances for the next sort
+    std::vector<Vec3d> positions; //Element positions to calc distance from (point, line centre, triangle centroid)
     unsigned int size = 0;
+    unsigned int capacity = 0;
     unsigned int order = 1; //Points=1, Tris=3
+    unsigned int ordered = 0; //Elements in keys from the last sort, kept as a starting order for the next
+    unsigned int opaque = 0; //Opaque elements loaded, flagged with maximum distance in buffer
+    bool incremental = false; //Last sort only had to repair the previous order
+    int threads = 0; //Sort threads, 0 = all cores
+    const std::atomic<unsigned int>* generation = NULL; //Sort request counter, abandon the sort if it moves on from stamp
+    unsigned int stamp = 0;
     std::vector<unsigned int> indices;
+    std::vector<unsigned int> back; //Sorted indices are written here, then swapped into indices by publish()
     bool changed;
 
     SortData() {}
@@ -153,32 +218,178 @@ class SortData
     {
       changed = true;
       if (buffer) delete[] buffer;
-      if (swap) delete[] swap;
-      buffer = swap = NULL;
-      size = 0;
-      indices.clear();
+      if (keys) delete[] keys;
+      buffer = NULL;
+      keys = NULL;
+      size = capacity = ordered = opaque = 0;
+      std::vector<unsigned int>().swap(indices);
+      std::vector<unsigned short>().swap(distances);
+      std::vector<Vec3d>().swap(positions);
+      std::vector<unsigned int>().swap(back);
     }
 
     void allocate(unsigned int newsize, unsigned int order=1)
     {
-      if (newsize == size) return;
-      clear();
+      //Elements are reloaded, previous order no longer applies
+      ordered = opaque = 0;
+      back.clear();
+      if (newsize == size && order == this->order) return;
+      //Buffer only grows, unless the size needed drops well below the high water mark
+      //(grows geometrically so data loaded in increments doesn't reallocate every time)
+      if (newsize > capacity || newsize < capacity / 4)
+      {
+        unsigned int alloc = newsize > capacity ? std::max(newsize, capacity * 3 / 2) : newsize;
+        if (buffer) delete[] buffer;
+        if (keys) delete[] keys;
+        buffer = new T[alloc];
+        keys = new uint64_t[alloc];
+        if (buffer == NULL || keys == NULL)
+          abort_program("Memory allocation error (failed to allocate %d bytes)", (sizeof(T) + sizeof(uint64_t)) * alloc);
+        capacity = alloc;
+        if (indices.capacity() > alloc * order * 4)
+        {
+          std::vector<unsigned int>().swap(indices);
+          std::vector<unsigned int>().swap(back);
+        }
+        if (distances.capacity() > alloc * 4)
+          std::vector<unsigned short>().swap(distances);
+        if (positions.capacity() > alloc * 4)
+          std::vector<Vec3d>().swap(positions);
+        indices.reserve(alloc * order);
+        distances.reserve(alloc);
+        positions.reserve(alloc);
+      }
       size = newsize;
       this->order = order;
-      buffer = new T[newsize];
-      swap = new T[newsize];
       indices.resize(newsize*order);
-      if (buffer == NULL || swap == NULL)
-        abort_program("Memory allocation error (failed to allocate %d bytes)", sizeof(T) * size * 2);
+      distances.resize(newsize);
+      positions.resize(newsize);
       changed = true;
     }
 
-    void sort(unsigned int N)
+    //Set the sort distance for element i, must be set for all elements before sort()
+    inline void key(unsigned int i, unsigned short distance)
+    {
+      distances[i] = distance;
+    }
+
+    //Opaque elements always sort last, overrides calculated distances
+    void opaqueKeys(unsigned int N)
+    {
+      if (!opaque) return;
+      for (unsigned int i=0; i<N; i++)
+        if (buffer[i].distance == USHRT_MAX)
+          distances[i] = USHRT_MAX;
+    }
+
+    //Element at position i in sorted order
+    inline T& sorted(unsigned int i)
+    {
+      return ordered ? buffer[keys[i] >> 16] : buffer[i];
+    }
+
+    //A newer sort has been requested, this one is out of date
+    inline bool cancelled()
+    {
+      return generation && *generation != stamp;
+    }
+
+    //Sorted index list to write to, starts as a copy of the current list after a reload
+    std::vector<unsigned int>& output()
+    {
+      if (back.size() != indices.size())
+        back = indices;
+      return back;
+    }
+
+    //Swap in the sorted index list, only holds the lock used for drawing while swapping
+    void publish(std::mutex& mutex)
+    {
+      LOCK_GUARD(mutex);
+      indices.swap(back);
+      changed = true;
+    }
+
+    //Returns false if cancelled, keys are left in a valid order to start the next sort from
+    bool sort(unsigned int N)
     {
       if (N > size) abort_program("Sort count out of range");
-      //Sort by each byte of 2 byte index
-      radix<T>(0, N, buffer, swap);
-      radix<T>(1, N, swap, buffer);
+      incremental = false;
+      if (cancelled()) return false;
+      if (ordered == N && N > 1)
+      {
+        //Update distances in the previous order, after a small view change this is nearly sorted
+        parallelRange(N, threads, [&](size_t start, size_t end, unsigned int t)
+        {
+          for (size_t i=start; i<end; i++)
+            keys[i] = (keys[i] & ~(uint64_t)0xffff) | distances[keys[i] >> 16];
+        }, 65536);
+
+        //Repair the order in place if few neighbours are out of order (sampled),
+        //gives up if it moves much more than the radix passes would
+        if (nearlySorted(N) && insertionSort(N, N * 2))
+        {
+          incremental = true;
+          return true;
+        }
+      }
+      else
+      {
+        parallelRange(N, threads, [&](size_t start, size_t end, unsigned int t)
+        {
+          for (size_t i=start; i<end; i++)
+            keys[i] = distances[i] | ((uint64_t)i << 16);
+        }, 65536);
+      }
+
+      //Sort the keys only by each byte of 2 byte distance, elements are left in place
+      //(first pass leaves keys untouched, so can stop between passes)
+      ordered = N;
+      if (cancelled()) return false;
+      uint64_t* swap = sortSwapBuffer<uint64_t>(N);
+      radix_parallel<uint64_t>(0, N, keys, swap, threads);
+      if (cancelled()) return false;
+      radix_parallel<uint64_t>(1, N, swap, keys, threads);
+      //Skip writing out the indices if the view moved on during the last pass
+      return !cancelled();
+    }
+
+    bool nearlySorted(unsigned int N, unsigned int samples=1024)
+    {
+      //Fraction of sampled neighbouring keys out of order, at most 1 in 20
+      if (samples > N-1) samples = N-1;
+      unsigned int step = (N-1) / samples;
+      unsigned int inversions = 0;
+      for (unsigned int s=0; s<samples; s++)
+      {
+        unsigned int i = s * step;
+        if ((keys[i] & 0xffff) > (keys[i+1] & 0xffff))
+          inversions++;
+      }
+      return inversions * 20 <= samples;
+    }
+
+    bool insertionSort(unsigned int N, size_t limit)
+    {
+      //Stable insertion sort by distance, keys remain a valid order if it gives up
+      //(also gives up if cancelled, checked every 64k elements)
+      size_t moves = 0;
+      for (unsigned int i=1; i<N; i++)
+      {
+        if ((i & 0xffff) == 0 && cancelled()) return false;
+        uint64_t k = keys[i];
+        unsigned short d = k & 0xffff;
+        unsigned int j = i;
+        while (j > 0 && (keys[j-1] & 0xffff) > d)
+        {
+          keys[j] = keys[j-1];
+          j--;
+        }
+        keys[j] = k;
+        moves += i - j;
+        if (moves > limit) return false;
+      }
+      return true;
     }
 };
 
@@ -200,7 +411,21 @@ class RenderData
 
 };
 
+//Default render data containers for a record, allocated together in one block
+class RenderStore
+{
+public:
+  Coord3DValues vertices, vectors, normals;
+  UIntValues indices, colours;
+  Coord2DValues texCoords;
+  UCharValues luminance, rgb;
+  RenderData render;
+
+  RenderStore() : render(vertices, vectors, normals, indices, colours, texCoords, luminance, rgb) {}
+};
+
 //Shared pointer so we can pass these around without issues
+typedef std::shared_ptr<RenderStore> Store_Ptr;
 typedef std::shared_ptr<RenderData> Render_Ptr;
 typedef std::shared_ptr<DataContainer> Data_Ptr;
 typedef std::shared_ptr<Coord3DValues> Float3_Ptr;
@@ -230,6 +455,8 @@ public:
   }
 
   virtual void operator()(Colour& colour, unsigned int idx) const;
+  //Batch lookup of count colours from index start
+  virtual void colourise(Colour* colours, unsigned int start, unsigned int count) const;
 };
 
 class ColourLookupMapped : public ColourLookup
@@ -238,6 +465,7 @@ class ColourLookupMapped : public ColourLookup
   ColourLookupMapped() {}
 
   virtual void operator()(Colour& colour, unsigned int idx) const;
+  virtual void colourise(Colour* colours, unsigned int start, unsigned int count) const;
 };
 
 class ColourLookupRGBA : public ColourLookup
@@ -271,6 +499,7 @@ class ColourLookupOpacityMapped : public ColourLookup
   ColourLookupOpacityMapped() {}
 
   virtual void operator()(Colour& colour, unsigned int idx) const;
+  virtual void colourise(Colour* colours, unsigned int start, unsigned int count) const;
 };
 
 class ColourLookupMappedOpacityMapped : public ColourLookup
@@ -279,6 +508,7 @@ class ColourLookupMappedOpacityMapped : public ColourLookup
   ColourLookupMappedOpacityMapped() {}
 
   virtual void operator()(Colour& colour, unsigned int idx) const;
+  virtual void colourise(Colour* colours, unsigned int start, unsigned int count) const;
 };
 
 class ColourLookupRGBAOpacityMapped : public ColourLookup
@@ -339,6 +569,11 @@ public:
 
   float distance; //For depth sorting
 
+  //Cached filter results, one bit per vertex, set if filtered out
+  std::vector<uint64_t> filterMask;
+  std::vector<double> filterInputs; //Filter settings and data state the mask was evaluated from
+  unsigned int filterStamp = 0;
+
   //Bounding box of content
   float min[3] = {HUGE_VALF, HUGE_VALF, HUGE_VALF};
   float max[3] = {-HUGE_VALF, -HUGE_VALF, -HUGE_VALF};
@@ -352,6 +587,8 @@ public:
   UChar_Ptr _luminance, _rgb;
 
   Render_Ptr render;
+  Store_Ptr store; //Containers replaced later are allocated separately
+  unsigned int shared = 0; //Store containers also used by other records after merging, bit per data type
 
   void readVertex(float* data)
   {
@@ -369,19 +606,25 @@ public:
     return sizeof(float);
   }
 
-  GeomData(DrawingObject* draw, lucGeometryType type, int step=-1)
+  GeomData(DrawingObject* draw, lucGeometryType type, int step=-1, std::shared_ptr<BlockPool> pool=nullptr)
     : draw(draw), type(type), step(step)
   {
     texture = std::make_shared<ImageLoader>(); //Add a new empty texture container
 
-    _vertices = std::make_shared<Coord3DValues>();
-    _vectors = std::make_shared<Coord3DValues>();
-    _normals = std::make_shared<Coord3DValues>();
-    _indices = std::make_shared<UIntValues>();
-    _colours = std::make_shared<UIntValues>();
-    _texCoords = std::make_shared<Coord2DValues>();
-    _luminance = std::make_shared<UCharValues>();
-    _rgb = std::make_shared<UCharValues>();
+    if (pool)
+      store = std::allocate_shared<RenderStore>(PoolAllocator<RenderStore>(pool));
+    else
+      store = std::make_shared<RenderStore>();
+
+    //Containers share ownership of the store
+    _vertices = Float3_Ptr(store, &store->vertices);
+    _vectors = Float3_Ptr(store, &store->vectors);
+    _normals = Float3_Ptr(store, &store->normals);
+    _indices = UInt_Ptr(store, &store->indices);
+    _colours = UInt_Ptr(store, &store->colours);
+    _texCoords = Float2_Ptr(store, &store->texCoords);
+    _luminance = UChar_Ptr(store, &store->luminance);
+    _rgb = UChar_Ptr(store, &store->rgb);
 
     setRenderData();
   }
@@ -405,7 +648,13 @@ public:
   void setRenderData()
   {
     //Required if any of the render data containers modified
-    render = std::make_shared<RenderData>(*_vertices, *_vectors, *_normals, *_indices, *_colours, *_texCoords, *_luminance, *_rgb);
+    //(while all are the original containers the store references can be used)
+    if (_vertices.get() == &store->vertices && _vectors.get() == &store->vectors && _normals.get() == &store->normals &&
+        _indices.get() == &store->indices && _colours.get() == &store->colours && _texCoords.get() == &store->texCoords &&
+        _luminance.get() == &store->luminance && _rgb.get() == &store->rgb)
+      render = Render_Ptr(store, &store->render);
+    else
+      render = std::make_shared<RenderData>(*_vertices, *_vectors, *_normals, *_indices, *_colours, *_texCoords, *_luminance, *_rgb);
   }
 
   Data_Ptr dataContainer(lucGeometryDataType type)
@@ -433,6 +682,68 @@ public:
     }
   }
 
+  //Default container in the store for a data type
+  DataContainer* storeContainer(lucGeometryDataType type)
+  {
+    switch (type)
+    {
+      case lucVertexData:
+        return &store->vertices;
+      case lucVectorData:
+        return &store->vectors;
+      case lucNormalData:
+        return &store->normals;
+      case lucIndexData:
+        return &store->indices;
+      case lucRGBAData:
+        return &store->colours;
+      case lucTexCoordData:
+        return &store->texCoords;
+      case lucLuminanceData:
+        return &store->luminance;
+      case lucRGBData:
+        return &store->rgb;
+      default:
+        return NULL;
+    }
+  }
+
+  //Flag store containers used by another record, so they are never released from here
+  void shareStore(GeomData& other)
+  {
+    for (unsigned int t=lucMinDataType; t<lucMaxDataType; t++)
+    {
+      Data_Ptr container = other.dataContainer((lucGeometryDataType)t);
+      if (container && container.get() == storeContainer((lucGeometryDataType)t))
+        shared |= 1 << t;
+    }
+  }
+
+  //Free the data of store containers that have been replaced
+  //(the store itself stays allocated while any container references it)
+  void releaseStore()
+  {
+    for (unsigned int t=lucMinDataType; t<lucMaxDataType; t++)
+    {
+      DataContainer* own = storeContainer((lucGeometryDataType)t);
+      Data_Ptr container = dataContainer((lucGeometryDataType)t);
+      if (own && container.get() != own && !(shared & (1 << t)))
+        own->release();
+    }
+  }
+
+  //Release unused space allocated while reading data
+  void shrink()
+  {
+    for (unsigned int t=lucMinDataType; t<lucMaxDataType; t++)
+    {
+      Data_Ptr container = dataContainer((lucGeometryDataType)t);
+      if (container) container->shrink();
+    }
+    for (auto v : values)
+      v->shrink();
+  }
+
   //Find labelled value store
   Values_Ptr valueContainer(const std::string& label)
   {
@@ -455,14 +766,16 @@ public:
   UCharValues& rgb()          {return *_rgb;}
 
   void checkPointMinMax(float *coord);
-  void calcBounds();
+  void calcBounds(int threads=0);
 
   void label(const std::string& labeltext);
   std::string getLabels();
   ColourLookup& colourCalibrate();
   int colourCount();
   unsigned int valuesLookup(const json& by);
+  void filterCalibrate();
   bool filter(unsigned int idx);
+  unsigned int unfiltered(unsigned int idx);
   FloatValues* colourData();
   float colourData(unsigned int idx);
   FloatValues* valueData(unsigned int vidx);
@@ -557,6 +870,7 @@ protected:
   GLuint indexvbo, vbo, vao;
   View* view;
   std::vector<Geom_Ptr> records;
+  std::map<int, std::shared_ptr<BlockPool> > pools; //Record storage per timestep, dropped when the step is cleared
   std::vector<Geom_Ptr> geom;
   std::vector<bool> hidden;
   unsigned int elements;
@@ -589,7 +903,8 @@ public:
   Geometry(Session& session);
   virtual ~Geometry();
 
-  void clear(bool fixed=false); //Called before new data loaded
+  virtual void clear(bool fixed=false); //Called before new data loaded
+  virtual void clearStep(int step);
   virtual void remove(DrawingObject* draw);
   void clearValues(DrawingObject* draw=NULL, std::string label="");
   void clearData(DrawingObject* draw, lucGeometryDataType dtype);
@@ -628,6 +943,8 @@ public:
   void read(Geom_Ptr geomdata, unsigned int n, lucGeometryDataType dtype, const void* data, int width=0, int height=0, int depth=0);
   Geom_Ptr read(DrawingObject* draw, unsigned int n, const void* data, std::string label, int width=0, int height=0, int depth=0);
   Geom_Ptr read(Geom_Ptr geom, unsigned int n, const void* data, std::string label, int width=0, int height=0, int depth=0);
+  Geom_Ptr reserve(DrawingObject* draw, unsigned int n, lucGeometryDataType dtype);
+  Geom_Ptr reserve(DrawingObject* draw, unsigned int n, std::string label);
   void addTriangle(DrawingObject* obj, float* a, float* b, float* c, int level, bool texCoords=false, float trilimit=0, float* normal=NULL);
   void scanDataRange(DrawingObject* draw);
   void setupObject(DrawingObject* draw);
@@ -671,14 +988,36 @@ public:
   void contour(Geometry* lines, DrawingObject* source, DrawingObject* target,  bool clearsurf);
 };
 
+//Vertex to triangle adjacency (CSR) for normal calculation
+//Reused while the index data it was built from is unchanged (eg: fixed indices over timesteps)
+class TriangleAdjacency
+{
+public:
+  TriangleAdjacency() : version(0), vertices(0), bytes(0) {}
+  ~TriangleAdjacency() {membytes__ -= bytes;}
+
+  std::weak_ptr<UIntValues> indices;
+  unsigned int version;
+  unsigned int vertices;
+  long bytes; //Counted in geometry memory usage
+  std::vector<unsigned int> offsets;   //Start of each vertex triangle list in triangles, vertices+1 entries
+  std::vector<unsigned int> triangles; //Triangles sharing each vertex, ascending
+};
+
 class Triangles : public Geometry
 {
 protected:
   unsigned int tricount;
+  std::map<UIntValues*, TriangleAdjacency> adjacency;
+  TriangleAdjacency& triangleAdjacency(unsigned int index);
+  void pruneAdjacency();
 public:
   Triangles(Session& session);
   virtual ~Triangles();
   virtual void close();
+  virtual void clear(bool fixed=false);
+  virtual void clearStep(int step);
+  virtual void remove(DrawingObject* draw);
   unsigned int triCount(unsigned int index);
   unsigned int triCount();
   virtual void update();
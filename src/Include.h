@@ -32,6 +32,7 @@
 #include <typeinfo>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
 #include <random>
 #include <chrono>
@@ -713,6 +713,8 @@ bool LavaVu::parseCommand(std::string cmd, bool gethelp)
   if (cmd.length() == 0) return false;
   if (viewer->isopen && !gethelp)
     viewer->display(false); //Display without redraw, ensures correct context active
+  //Commands may modify properties directly
+  session.stamp++;
   //Trim leading whitespace
   size_t pos = cmd.find_first_not_of(" \t\n\r");
   if (std::string::npos != pos) cmd = cmd.substr(pos);
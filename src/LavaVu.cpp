@@ -154,6 +154,7 @@ void LavaVu::defaults()
   session.reset();
   //Clear globals
   session.globals = json::object();
+  session.stamp++;
 
   //Clear any queued commands
   viewer->commands.clear();
@@ -205,6 +206,7 @@ void LavaVu::destroy()
     if (sort_thread.joinable())
     {
       viewer->quitProgram = true;
+      session.sortGeneration++; //Abandon any sort in progress
       sortcv.notify_one();
       sort_thread.join();
     }
@@ -2045,6 +2047,8 @@ bool LavaVu::sort(bool sync)
 {
   //Run the renderer sort functions
   //by default in a thread
+  //Each request is stamped, sorts still running for an earlier request give up
+  session.sortGeneration++;
   if (sync)
   {
     //Synchronous immediate sort
@@ -2069,38 +2073,38 @@ bool LavaVu::sort(bool sync)
         std::unique_lock<std::mutex> lk(sort_mutex);
         sortcv.wait(lk, [&]{return sorting || viewer->quitProgram;});
 
+        //Let the view settle, newer requests during the wait replace this one
+        sortcv.wait_for(lk, std::chrono::milliseconds(50), [&]{return viewer->quitProgram;});
         if (viewer->quitProgram)
           return;
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        //Sort without holding the request lock, so new requests can pre-empt
+        sorting = false;
+        unsigned int current = session.sortGeneration;
+        lk.unlock();
+
         for (auto g : amodel->geometry)
         {
+          if (session.sortGeneration != current)
+            break;
           LOCK_GUARD(g->sortmutex);
           //Not required if reload flagged, will be done in update()
           if (!g->reload)
             g->sort();
         }
 
-        if (!animate)
+        //Skip the redisplay if out of date, the newer request will follow
+        if (session.sortGeneration == current && !animate)
           queueCommands("display");
-
-        // Manual unlocking is done before notifying, to avoid waking up
-        // the waiting thread only to block again (see notify_one for details)
-        sorting = false;
-        lk.unlock();
-        sortcv.notify_one();
       }
     });
   }
 
-  //Notify worker thread ready to sort (if not already sorting)
-  if (sort_mutex.try_lock())
+  //Notify worker thread ready to sort, replaces any request waiting or in progress
   {
+    LOCK_GUARD(sort_mutex);
     sorting = true;
-    sort_mutex.unlock();
   }
-  else
-    return false;
   sortcv.notify_one();
   return true;
 }
@@ -3635,6 +3639,22 @@ Geom_Ptr LavaVu::arrayFloat(DrawingObject* target, float* array, int len, std::s
   return p;
 }
 
+void LavaVu::reserveData(DrawingObject* target, int count, lucGeometryDataType type)
+{
+  if (!amodel || !target) return;
+  Geometry* container = amodel->lookupObjectRenderer(target);
+  if (container)
+    container->reserve(target, count, type);
+}
+
+void LavaVu::reserveValues(DrawingObject* target, int count, std::string label)
+{
+  if (!amodel || !target) return;
+  Geometry* container = amodel->lookupObjectRenderer(target);
+  if (container)
+    container->reserve(target, count, label);
+}
+
 void LavaVu::clearTexture(DrawingObject* target, std::string label)
 {
   GL_Check_Thread(viewer->render_thread);
@@ -126,9 +126,9 @@ void Lines::loadBuffers()
     //Calibrate colour maps on range for this object
     ColourLookup& getColour = geom[i]->colourCalibrate();
 
-    Properties& props = geom[i]->draw->properties;
-    float limit = props["limit"];
-    bool linked = props["link"];
+    const RenderProperties& props = geom[i]->draw->compiled();
+    float limit = props.limit;
+    bool linked = props.link;
     if (linked) limit = 0.f;
 
     unsigned int hasColours = geom[i]->colourCount();
@@ -136,6 +136,12 @@ void Lines::loadBuffers()
     if (colrange < 1) colrange = 1;
     debug_print("Using 1 colour per %d vertices (%d : %d)\n", colrange, geom[i]->count(), hasColours);
 
+    //Lookup all the colours required in one pass
+    unsigned int ncolours = geom[i]->count() ? (geom[i]->count()-1) / colrange + 1 : 0;
+    if (hasColours && ncolours > hasColours) ncolours = hasColours;
+    std::vector<Colour> colours(ncolours);
+    getColour.colourise(colours.data(), 0, ncolours);
+
     Colour colour;
     bool filter = geom[i]->draw->filterCache.size();
     for (unsigned int v=0; v < geom[i]->count(); v++)
@@ -157,9 +163,8 @@ void Lines::loadBuffers()
       }
 
       //Have colour values but not enough for per-vertex, spread over range (eg: per segment)
-      unsigned int cidx = v / colrange;
-      if (cidx >= hasColours) cidx = hasColours - 1;
-      getColour(colour, cidx);
+      if (ncolours)
+        colour = colours[std::min(v / colrange, ncolours-1)];
       //if (cidx%100 ==0) printf("COLOUR %d => %d,%d,%d\n", cidx, colour.r, colour.g, colour.b);
 
       //Write vertex data to vbo
@@ -298,23 +303,23 @@ void Lines::draw()
 
     for (unsigned int i=0; i<geom.size(); i++)
     {
-      Properties& props = geom[i]->draw->properties;
+      const RenderProperties& props = geom[i]->draw->compiled();
       if (drawable(i))
       {
         //Set draw state
         setState(i);
 
         //Lines specific state
-        float scaling = props["scalelines"];
+        float scaling = props.scalelines;
         //Don't apply object scaling to internal lines objects
-        if (!internal) scaling *= (float)props["scaling"];
-        float lineWidth = (float)props["linewidth"] * scaling;
+        if (!internal) scaling *= props.scaling;
+        float lineWidth = props.linewidth * scaling;
         if (lineWidth <= 0) lineWidth = scaling;
-        session.context.setLineWidth(lineWidth, props["upscalelines"]);
+        session.context.setLineWidth(lineWidth, props.upscalelines);
 
-        if (props["loop"])
+        if (props.loop)
           primitive = GL_LINE_LOOP;
-        else if (props["link"])
+        else if (props.link)
           primitive = GL_LINE_STRIP;
 
         if (geom[i]->render->indices.size() > 0)
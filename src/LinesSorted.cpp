@@ -149,6 +149,8 @@ void LinesSorted::loadList()
 
   //Create sorting array
   sorter.allocate(total/2, 2);
+  sorter.threads = session.global("threads");
+  sorter.generation = &session.sortGeneration;
 
   //Element counts to actually plot (exclude filtered/hidden) per geom entry
   counts.clear();
@@ -195,13 +197,13 @@ void LinesSorted::loadList()
       if (opaque)
       {
         sorter.buffer[linecount].distance = USHRT_MAX;
-        sorter.buffer[linecount].vertex = NULL;
+        sorter.opaque++;
       }
       else
       {
         //Line centre for depth sorting
         assert(offset < centres.size());
-        sorter.buffer[linecount].vertex = centres[offset].ref();
+        sorter.positions[linecount] = centres[offset];
       }
       linecount++;
       counts[index] += 2; //Element count
@@ -229,38 +231,24 @@ void LinesSorted::sort()
   assert(sorter.buffer);
 
   //Calculate min/max distances from view plane
+  sorter.stamp = session.sortGeneration;
   float distanceRange[2];
   view->getMinMaxDistance(min, max, distanceRange, true);
 
-  //Update eye distances, clamping int distance to integer between 1 and 65534
-  float multiplier = (USHRT_MAX-1.0) / (distanceRange[1] - distanceRange[0]);
-  unsigned int opaqueCount = 0;
-  float fdistance;
-  for (unsigned int i = 0; i < linecount; i++)
+  //Update eye distances, clamping int distance to integer between 0 and 65534
+  //Distance from viewing plane is -eyeZ, max dist 65535 reserved for opaque lines
+  if (sorter.opaque < linecount && !view->eyePlaneKeys(sorter.positions.data(), linecount, distanceRange, sorter.distances.data(), sorter.threads, sorter.generation, sorter.stamp))
   {
-    //Distance from viewing plane is -eyeZ
-    //Max dist 65535 reserved for opaque triangles
-    if (sorter.buffer[i].distance < USHRT_MAX)
-    {
-      assert(sorter.buffer[i].vertex);
-      fdistance = view->eyePlaneDistance(sorter.buffer[i].vertex);
-      //fdistance = view->eyeDistance(sorter.buffer[i].vertex);
-      fdistance = std::min(distanceRange[1], std::max(distanceRange[0], fdistance)); //Clamp to range
-      sorter.buffer[i].distance = (unsigned short)(multiplier * (fdistance - distanceRange[0]));
-      //if (i%10000==0) printf("%d : centroid %f %f %f\n", i, sorter.buffer[i].vertex[0], sorter.buffer[i].vertex[1], sorter.buffer[i].vertex[2]);
-      //Reverse as radix sort is ascending and we want to draw by distance descending
-      //sorter.buffer[i].distance = USHRT_MAX - (unsigned short)(multiplier * (fdistance - mindist));
-      //assert(sorter.buffer[i].distance >= 1 && sorter.buffer[i].distance <= USHRT_MAX);
-    }
-    else
-      opaqueCount++;
+    debug_print("  sort cancelled, view changed\n");
+    return;
   }
+  sorter.opaqueKeys(linecount);
   t2 = clock();
   debug_print("  %.4lf seconds to calculate distances\n", (t2-t1)/(double)CLOCKS_PER_SEC);
   t1 = clock();
 
   //Skip sort if all opaque
-  if (opaqueCount == linecount) 
+  if (sorter.opaque == linecount)
   {
     debug_print("No sort necessary\n");
     return;
@@ -276,20 +264,24 @@ void LinesSorted::sort()
   if (view->is3d)
   {
     //Depth sort using 2-byte key radix sort, 10 times faster than equivalent quicksort
-    sorter.sort(linecount);
+    if (!sorter.sort(linecount))
+    {
+      debug_print("  sort cancelled, view changed\n");
+      return;
+    }
     t2 = clock();
-    debug_print("  %.4lf seconds to sort %d lines\n", (t2-t1)/(double)CLOCKS_PER_SEC, linecount);
+    debug_print("  %.4lf seconds to sort %d lines%s\n", (t2-t1)/(double)CLOCKS_PER_SEC, linecount, sorter.incremental ? " (incremental)" : "");
   }
 
-  //Lock the update mutex, to allow updating the indexlist and prevent access while drawing
+  //Write the new index list aside, drawing continues with the old one until swapped in
   t1 = clock();
-  LOCK_GUARD(loadmutex);
+  std::vector<unsigned int>& indices = sorter.output();
   unsigned int idxcount = 0;
   for(int i=linecount-1; i>=0; i--)
   {
     assert(idxcount < 2 * linecount * sizeof(unsigned int));
     //Copy index bytes
-    memcpy(&sorter.indices[idxcount], sorter.buffer[i].index, sizeof(GLuint) * 2);
+    memcpy(&indices[idxcount], sorter.sorted(i).index, sizeof(GLuint) * 2);
     idxcount += 2;
     //if (i%100==0) printf("%d ==> %d,%d,%d\n", i, sorter.buffer[i].index[0], sorter.buffer[i].index[1]);
   }
@@ -297,8 +289,8 @@ void LinesSorted::sort()
   t2 = clock();
   debug_print("  %.4lf seconds to save %d line indices\n", (t2-t1)/(double)CLOCKS_PER_SEC, linecount*2);
 
-  //Force update after sort
-  sorter.changed = true;
+  //Swap in, forces update after sort
+  sorter.publish(loadmutex);
 }
 
 //Reloads triangle indices, required after data update and depth sort
@@ -69,12 +69,14 @@ Database::Database(const FilePath& fn) : readonly(true), silent(true), attached(
 
 Database::~Database()
 {
+  clearAttached();
   if (db) sqlite3_close(db);
 }
 
 bool Database::open(bool write)
 {
   //Single file database
+  clearAttached();
   if (db) sqlite3_close(db);
   char path[FILE_PATH_MAX];
   int flags = SQLITE_OPEN_READONLY;
@@ -119,52 +121,97 @@ void Database::reopen(bool write)
   //Re-attach any attached db file
   if (attached)
   {
-    char SQL[SQL_QUERY_MAX];
-    sprintf(SQL, "attach database '%s' as t%d", attached->path.c_str(), attached->step);
-    if (issue(SQL))
-      debug_print("Database %s found and re-attached\n", attached->path.c_str());
+    TimeStep* timestep = attached;
+    attached = NULL;
+    attach(timestep);
   }
 }
 
 void Database::attach(TimeStep* timestep)
 {
-  //Detach any attached db file
+  //Attach n'th timestep database if available, keeping previously attached
+  //files in a pool so returning to a recent step doesn't reopen the file
   if (memory) return;
-  char SQL[SQL_QUERY_MAX];
-  if (attached && attached->step != timestep->step)
+  attached = NULL;
+  prefix[0] = '\0';
+
+  const std::string& path = timestep->path;
+  if (timestep->step <= 0 || path.length() == 0)
   {
-    sprintf(SQL, "detach database 't%d'", attached->step);
-    if (issue(SQL))
-    {
-      debug_print("Database t%d detached\n", attached->step);
-      attached = NULL;
-      prefix[0] = '\0';
-    }
-    else
-      debug_print("Database t%d detach failed!\n", attached->step);
+    //debug_print("Database %s not found, loading from current db\n", path.c_str());
+    return;
+  }
+
+  Attachment* a = findAttached(timestep->step);
+  if (a && a->path != path)
+  {
+    //Same step from a different file, replace
+    if (!detach(a - pool.data())) return;
+    a = NULL;
   }
 
-  //Attach n'th timestep database if available
-  if (timestep->step > 0 && !attached)
+  if (!a)
   {
-    const std::string& path = timestep->path;
-    if (path.length() > 0)
+    //Detach least recently used files to stay within the attached database limit
+    unsigned int limit = sqlite3_limit(db, SQLITE_LIMIT_ATTACHED, -1);
+    while (pool.size() > 0 && pool.size() >= limit)
     {
-      sprintf(SQL, "attach database '%s' as t%d", path.c_str(), timestep->step);
-      if (issue(SQL))
-      {
-        sprintf(prefix, "t%d.", timestep->step);
-        debug_print("Database %s found and attached\n", path.c_str());
-        attached = timestep;
-      }
-      else
-      {
-        debug_print("Database %s found but attach failed!\n", path.c_str());
-      }
+      unsigned int lru = 0;
+      for (unsigned int i=1; i<pool.size(); i++)
+        if (pool[i].used < pool[lru].used) lru = i;
+      if (!detach(lru)) break;
+    }
+
+    char SQL[SQL_QUERY_MAX];
+    sprintf(SQL, "attach database '%s' as t%d", path.c_str(), timestep->step);
+    if (!issue(SQL))
+    {
+      debug_print("Database %s found but attach failed!\n", path.c_str());
+      return;
     }
-    //else
-    //   debug_print("Database %s not found, loading from current db\n", path.c_str());
+    debug_print("Database %s found and attached\n", path.c_str());
+    pool.push_back(Attachment(timestep->step, path));
+    a = &pool.back();
+  }
+
+  a->used = ++accesses;
+  sprintf(prefix, "t%d.", timestep->step);
+  attached = timestep;
+}
+
+Attachment* Database::findAttached(int step)
+{
+  for (auto& a : pool)
+    if (a.step == step) return &a;
+  return NULL;
+}
+
+bool Database::detach(unsigned int idx)
+{
+  //Cached statements must be finalized before the file can be detached
+  Attachment& a = pool[idx];
+  for (auto& s : a.statements)
+    sqlite3_finalize(s.second);
+  a.statements.clear();
+  char SQL[SQL_QUERY_MAX];
+  sprintf(SQL, "detach database 't%d'", a.step);
+  if (!issue(SQL))
+  {
+    debug_print("Database t%d detach failed!\n", a.step);
+    return false;
   }
+  debug_print("Database t%d detached\n", a.step);
+  pool.erase(pool.begin() + idx);
+  return true;
+}
+
+void Database::clearAttached()
+{
+  //Finalize cached statements, attachments are closed with the connection
+  for (auto& a : pool)
+    for (auto& s : a.statements)
+      sqlite3_finalize(s.second);
+  pool.clear();
 }
 
 //SQLite3 utility functions
@@ -185,6 +232,43 @@ sqlite3_stmt* Database::select(const char* fmt, ...)
   return statement;
 }
 
+sqlite3_stmt* Database::prepare(const char* fmt, ...)
+{
+  //As select(), but statements on an attached timestep database are cached
+  //and reused, return them with release() instead of finalizing
+  GET_VAR_ARGS(fmt, SQL);
+  std::string key = SQL;
+  Attachment* a = attached ? findAttached(attached->step) : NULL;
+  if (!a) return select("%s", key.c_str());
+
+  auto it = a->statements.find(key);
+  if (it != a->statements.end())
+    return it->second;
+
+  sqlite3_stmt* statement = select("%s", key.c_str());
+  if (statement)
+    a->statements[key] = statement;
+  return statement;
+}
+
+void Database::release(sqlite3_stmt* statement)
+{
+  //Reset statement if cached, otherwise finalize
+  for (auto& a : pool)
+  {
+    for (auto& s : a.statements)
+    {
+      if (s.second == statement)
+      {
+        sqlite3_reset(statement);
+        sqlite3_clear_bindings(statement);
+        return;
+      }
+    }
+  }
+  sqlite3_finalize(statement);
+}
+
 bool Database::issue(const char* fmt, ...)
 {
   GET_VAR_ARGS(fmt, SQL);
@@ -201,7 +285,7 @@ bool Database::issue(const char* fmt, ...)
   return true;
 }
 
-Model::Model(Session& session) : now(-1), session(session), figure(-1)
+Model::Model(Session& session) : now(-1), session(session), prefetch_cancel(false), figure(-1)
 {
 }
 
@@ -407,6 +491,13 @@ void Model::clearRenderers()
 
 Model::~Model()
 {
+  clearPrefetch();
+  {
+    LOCK_GUARD(prefetch_mutex);
+    prefetch_quit = true;
+  }
+  prefetch_cv.notify_one();
+  if (prefetch_thread.joinable()) prefetch_thread.join();
   clearRenderers();
   clearTimeSteps();
 
@@ -464,6 +555,7 @@ bool Model::loadFigure(int fig, bool preserveGlobals)
   //Preserves existing global settings by merging after load
   if (preserveGlobals)
     Properties::mergeJSON(session.globals, globals);
+  session.stamp++;
 
   return true;
 }
@@ -1103,6 +1195,7 @@ void Model::loadLinks(DrawingObject* obj)
 
 void Model::clearTimeSteps()
 {
+  clearPrefetch();
   for (unsigned int idx=0; idx < timesteps.size(); idx++)
     delete timesteps[idx];
   timesteps.clear();
@@ -1122,14 +1215,28 @@ int Model::loadTimeSteps(bool scan)
   //Scan for additional timestep records/files with corresponding entries in timestep table
   if (!scan && database)
   {
-    sqlite3_stmt* statement = database.select("SELECT * from timestep");
+    //Geometry record count and data size of each step, from a single pass over the table
+    std::map<int, std::pair<unsigned int, size_t>> manifest;
+    sqlite3_stmt* statement = database.select("SELECT timestep, count(id), sum(length(data)) FROM geometry GROUP BY timestep");
+    if (statement)
+    {
+      //Add index covering step/object lookups if missing and file is writable
+      if (!database.readonly)
+        database.issue("CREATE INDEX IF NOT EXISTS idx_timestep_object_type ON geometry (timestep,object_id,type)");
+      while (sqlite3_step(statement) == SQLITE_ROW)
+        manifest[sqlite3_column_int(statement, 0)] = std::make_pair(sqlite3_column_int(statement, 1), (size_t)sqlite3_column_int64(statement, 2));
+      sqlite3_finalize(statement);
+    }
+
+    statement = database.select("SELECT * from timestep");
     //(id, time, dim_factor, units)
     while (sqlite3_step(statement) == SQLITE_ROW)
     {
       int step = sqlite3_column_int(statement, 0);
-      sqlite3_stmt* statement2 = database.select("SELECT count(id) from geometry where timestep = %d", step);
-      int geomcount = sqlite3_column_int(statement2, 0);
-      sqlite3_finalize(statement2);
+      unsigned int geomcount = 0;
+      auto it = manifest.find(step);
+      if (it != manifest.end())
+        geomcount = it->second.first;
       //Get timestep props
       std::string props = "";
       if (sqlite3_column_type(statement, 4) != SQLITE_NULL)
@@ -1137,6 +1244,8 @@ int Model::loadTimeSteps(bool scan)
 
       //Create the timestep
       addTimeStep(step, props);
+      timesteps[rows]->records = geomcount;
+      if (geomcount) timesteps[rows]->bytes = it->second.second;
 
       //Set time property if provided
       if (sqlite3_column_type(statement, 1) != SQLITE_NULL)
@@ -1357,6 +1466,36 @@ void Model::cacheLoad()
   std::cout << std::endl;
 }
 
+void Model::cacheEvict()
+{
+  //Remove least recently used timestep data until memory usage is within "cachesize" limit
+  //(Fixed data and the current step are always retained)
+  long limit = (long)session.global("cachesize") * 1000000;
+  if (limit <= 0) return;
+  while (membytes__ > limit)
+  {
+    int lru = -1;
+    for (int idx=0; idx < (int)timesteps.size(); idx++)
+    {
+      if (idx == now || !timesteps[idx]->loaded) continue;
+      //Oldest first, then furthest from current step
+      if (lru < 0 || timesteps[idx]->used < timesteps[lru]->used ||
+          (timesteps[idx]->used == timesteps[lru]->used && abs(idx - now) > abs(lru - now)))
+        lru = idx;
+    }
+    if (lru < 0) break;
+
+    debug_print("Removing step %d from cache, geom memory usage %.3f mb\n", timesteps[lru]->step, membytes__/1000000.0f);
+    for (auto g : geometry)
+    {
+      //Wait until all sort threads done
+      LOCK_GUARD(g->sortmutex);
+      g->clearStep(timesteps[lru]->step);
+    }
+    timesteps[lru]->loaded = false;
+  }
+}
+
 //Set time step if available, otherwise return false and leave unchanged
 bool Model::hasTimeStep(int ts)
 {
@@ -1489,19 +1628,33 @@ int Model::setTimeStep(int stepidx)
             std::cout << '.' << std::flush;
           }
           else
-            rows += loadGeometry();
+          {
+            //Use data from background loader if available
+            int loaded = loadPrefetched(step());
+            rows += loaded >= 0 ? loaded : loadGeometry();
+          }
 
           debug_print("%.4lf seconds to load %d geometry records from database\n", (clock()-t1)/(double)CLOCKS_PER_SEC, rows);
         }
       }
       else
         debug_print("Step already cached\n");
+
+      //Keep cached steps within memory limit
+      timesteps[now]->used = ++accesses;
+      cacheEvict();
+
+      //Start loading the following steps in the background
+      prefetch(now);
     }
   }
 
   //Load temporal properties
   if (session.now >= 0)
+  {
     Properties::mergeJSON(session.globals, session.timesteps[session.now]->properties.data);
+    session.stamp++;
+  }
 
   return rows;
 }
@@ -1541,24 +1694,50 @@ int Model::loadGeometry(int obj_id, int time_start, int time_stop)
   else
     strcpy(filter, objfilter);
 
+  sqlite3_stmt* statement = selectGeometry(database, filter);
+  if (!statement) return 0;
+
+  //Iterate and process the geometry
+  return readGeometryRecords(statement);
+}
+
+//Rows larger than this are streamed directly into their data container when loaded
+#define GEOM_STREAM_BYTES 16000000
+#define GEOM_STREAM_CHUNK 1000000
+
+std::string Model::geometryData(const char* prefix, bool stream)
+{
+  //Data columns of a geometry select: data, length(data), source database prefix
+  //When streaming, data of large rows that need no filtering is not returned (NULL),
+  //as the select would hold a copy of it, the row is read by streamGeometryRecord instead
+  char columns[256];
+  if (stream)
+    snprintf(columns, 256, "CASE WHEN length(data) > %d AND type != %d AND ifnull(dim_factor,0) < %d THEN NULL ELSE data END,length(data),'%s'",
+             GEOM_STREAM_BYTES, lucTracerType, GEOM_CODEC_VERSION, prefix);
+  else
+    snprintf(columns, 256, "data,length(data),'%s'", prefix);
+  return std::string(columns);
+}
+
+sqlite3_stmt* Model::selectGeometry(Database& db, const char* filter, bool stream)
+{
   //object (id, name, colourmap_id, colour, opacity, wireframe, cullface, scaling, lineWidth, arrowHead, flat, steps, time)
   //geometry (id, object_id, timestep, rank, idx, type, data_type, size, count, width, minimum, maximum, dim_factor, units, labels,
   //minX, minY, minZ, maxX, maxY, maxZ, data)
-  sqlite3_stmt* statement = database.select("SELECT id,object_id,timestep,rank,idx,type,data_type,size,count,width,minimum,maximum,dim_factor,units,labels,minX,minY,minZ,maxX,maxY,maxZ,data FROM %sgeometry WHERE %s ORDER BY timestep,object_id", database.prefix, filter);
+  //(cached when reading from an attached timestep database, return with db.release())
+  std::string data = geometryData(db.prefix, stream);
+  sqlite3_stmt* statement = db.prepare("SELECT id,object_id,timestep,rank,idx,type,data_type,size,count,width,minimum,maximum,dim_factor,units,labels,minX,minY,minZ,maxX,maxY,maxZ,%s FROM %sgeometry WHERE %s ORDER BY timestep,object_id", data.c_str(), db.prefix, filter);
 
   //Old database compatibility
   if (statement == NULL)
   {
     //object (id, name, colourmap_id, colour, opacity, wireframe, cullface, scaling, lineWidth, arrowHead, flat, steps, time)
     //geometry (id, object_id, timestep, rank, idx, type, data_type, size, count, width, minimum, maximum, dim_factor, units, data)
-    statement = database.select("SELECT id,object_id,timestep,rank,idx,type,data_type,size,count,width,minimum,maximum,dim_factor,units,labels,NULL,NULL,NULL,NULL,NULL,NULL,data FROM %sgeometry WHERE %s ORDER BY timestep,object_id", database.prefix, filter);
+    statement = db.prepare("SELECT id,object_id,timestep,rank,idx,type,data_type,size,count,width,minimum,maximum,dim_factor,units,labels,NULL,NULL,NULL,NULL,NULL,NULL,%s FROM %sgeometry WHERE %s ORDER BY timestep,object_id", data.c_str(), db.prefix, filter);
     printf("Using legacy GLDB format\n");
   }
 
-  if (!statement) return 0;
-
-  //Iterate and process the geometry
-  return readGeometryRecords(statement);
+  return statement;
 }
 
 int Model::loadFixedGeometry(int obj_id)
@@ -1582,7 +1761,8 @@ int Model::loadFixedGeometry(int obj_id)
   //object (id, name, colourmap_id, colour, opacity, wireframe, cullface, scaling, lineWidth, arrowHead, flat, steps, time)
   //geometry (id, object_id, timestep, rank, idx, type, data_type, size, count, width, minimum, maximum, dim_factor, units, labels,
   //minX, minY, minZ, maxX, maxY, maxZ, data)
-  sqlite3_stmt* statement = database.select("SELECT id,object_id,timestep,rank,idx,type,data_type,size,count,width,minimum,maximum,dim_factor,units,labels,minX,minY,minZ,maxX,maxY,maxZ,data FROM geometry WHERE %s ORDER BY timestep,object_id", filter);
+  std::string data = geometryData("", true);
+  sqlite3_stmt* statement = database.select("SELECT id,object_id,timestep,rank,idx,type,data_type,size,count,width,minimum,maximum,dim_factor,units,labels,minX,minY,minZ,maxX,maxY,maxZ,%s FROM geometry WHERE %s ORDER BY timestep,object_id", data.c_str(), filter);
 
   if (!statement) return 0;
 
@@ -1590,203 +1770,618 @@ int Model::loadFixedGeometry(int obj_id)
   return readGeometryRecords(statement, false);
 }
 
+//Limits on rows and data held by each batch of the read pipeline
+#define GEOM_BATCH_ROWS 256
+#define GEOM_BATCH_BYTES 64000000
+
+void GeometryRecord::inflate()
+{
+  //(already inflated if compressed data released)
+  if (stream || !compressed() || (blob.empty() && buffer.size())) return;
+  unsigned int elsize = GeomData::byteSize(data_type);
+  unsigned int qbytes = 0;
+  if (codec >= GEOM_CODEC_VERSION)
+  {
+    if ((codec & ~GEOM_CODEC_ALL) != GEOM_CODEC_VERSION ||
+        ((codec & GEOM_CODEC_QUANT8) && (codec & GEOM_CODEC_QUANT16)))
+    {
+      error = -2; //Unsupported codec
+      return;
+    }
+    if (codec & GEOM_CODEC_QUANT8) qbytes = 1;
+    if (codec & GEOM_CODEC_QUANT16) qbytes = 2;
+  }
+  else
+    codec = 0;
+
+  //Decompress!
+  //(quantized data is decompressed to a temporary buffer, prefixed by component ranges)
+  unsigned long dst_len = (unsigned long)(count * elsize);
+  unsigned long header = qbytes ? size * 2 * sizeof(float) : 0;
+  unsigned long enc_len = qbytes ? header + count * qbytes : dst_len;
+  unsigned long uncomp_len = enc_len;
+  unsigned long cmp_len = blob.size();
+  std::vector<unsigned char> quantized;
+  std::vector<unsigned char>& target = qbytes ? quantized : buffer;
+  target.resize(enc_len);
+
+#ifdef USE_ZLIB
+  int res = uncompress(target.data(), &uncomp_len, blob.data(), cmp_len);
+  if (res != Z_OK || enc_len != uncomp_len)
+#else
+  int res = tinfl_decompress_mem_to_mem(target.data(), uncomp_len, blob.data(), cmp_len, TINFL_FLAG_PARSE_ZLIB_HEADER);
+  if (!res)
+#endif
+  {
+    error = res ? res : -1;
+    return;
+  }
+
+  //Reverse any pre-compression filtering
+  if (codec)
+    geometryDecode(target.data() + header, enc_len - header, qbytes ? qbytes : elsize, size, codec);
+
+  //Temporal, restore from difference with keyframe data
+  if (codec & GEOM_CODEC_TEMPORAL)
+  {
+    if (!keyframe)
+    {
+      error = -3;
+      return;
+    }
+    //(keyframes are inflated once when read, only read here as shared between records)
+    if (keyframe->error || keyframe->bytes() != dst_len)
+    {
+      error = keyframe->error ? keyframe->error : -3;
+      return;
+    }
+    const unsigned char* key = (const unsigned char*)keyframe->data();
+    for (unsigned long i=0; i<dst_len; i++)
+      target[i] ^= key[i];
+    keyframe = nullptr;
+  }
+
+  //Expand quantized data
+  if (qbytes)
+  {
+    buffer.resize(dst_len);
+    geometryDequantize(quantized.data(), count, size, qbytes, (float*)buffer.data());
+  }
+
+  //Compressed data no longer required
+  std::vector<unsigned char>().swap(blob);
+}
+
 int Model::readGeometryRecords(sqlite3_stmt* statement, bool cache)
 {
+  //Staged reader:
+  // - rows are read from the database in batches on this thread
+  // - each batch is decompressed by a pool of worker threads
+  //   while the next batch is read and the previous batch is loaded
+  // - decompressed records are loaded into renderers in row order
   clock_t t1 = clock();
   int rows = 0;
-  int tbytes = 0;
-  int ret;
-  Geometry* active = NULL;
-  do
+  long tbytes = 0;
+  int threads = session.global("threads");
+  std::vector<GeometryRecord> reading, inflating;
+  KeyframeCache keyframes;
+  std::thread inflater;
+  bool more = true;
+
+  auto inflateBatch = [threads](std::vector<GeometryRecord>* batch)
+  {
+    parallelTasks(batch->size(), threads, [batch](size_t i) {(*batch)[i].inflate();});
+  };
+
+  try
   {
-    ret = sqlite3_step(statement);
-    if (ret == SQLITE_ROW)
+    while (more || inflating.size())
     {
-      rows++;
-      int object_id = sqlite3_column_int(statement, 1);
-      int timestep = sqlite3_column_int(statement, 2);
-      int height = sqlite3_column_int(statement, 3);  //unused - was rank, now height
-      int depth = sqlite3_column_int(statement, 4); //unused - was idx, now depth
-      lucGeometryType type = (lucGeometryType)sqlite3_column_int(statement, 5);
-      lucGeometryDataType data_type = (lucGeometryDataType)sqlite3_column_int(statement, 6);
-      int size = sqlite3_column_int(statement, 7);
-      int count = sqlite3_column_int(statement, 8);
-      int items = count / size;
-      int width = sqlite3_column_int(statement, 9);
-      if (height == 0) height = width > 0 ? items / width : 0;
-      float minimum = (float)sqlite3_column_double(statement, 10);
-      float maximum = (float)sqlite3_column_double(statement, 11);
-      //Clear if default
-      if (maximum - minimum == 1.0) maximum = minimum = 0.0;
-      //Units field repurposed for data label
-      const char *data_label = (const char*)sqlite3_column_text(statement, 13);
-      const char *labels = (const char*)sqlite3_column_text(statement, 14);
-
-      //printf("%d] OBJ %d STEP %d TYPE %d DTYPE %d DIMS (%d x %d x %d) COUNT %d ITEMS %d LABELS %s\n", 
-      //       rows, object_id, timestep, type, data_type, width, height, depth, count, items, labels);
-
-      const void *data = sqlite3_column_blob(statement, 21);
-      unsigned int bytes = sqlite3_column_bytes(statement, 21);
-
-      DrawingObject* obj = findObject(object_id);
-
-      //Deleted or Skip object? (When noload enabled)
-      if (!obj || obj->skip) continue;
-
-      //Bulk load: switch timestep and cache if timestep changes!
-      // - disabled when using attached databases (cached in loop via cacheLoad())
-      if (cache && step() != timestep && !database.attached)
+      //Read the next batch of rows
+      size_t batchbytes = 0;
+      while (more && reading.size() < GEOM_BATCH_ROWS && batchbytes < GEOM_BATCH_BYTES)
       {
-        std::cout << '~' << std::flush;
-        if (timestep > 0 && timestep%10==0) std::cout << std::setw(4) << timestep << " " << std::flush;
-        if (timestep > 0 && timestep%50==0) std::cout << std::endl;
-        //Change active timestep
-        session.now = now = nearestTimeStep(timestep);
-        //Flag all data loaded at this step
-        timesteps[now]->loaded = true;
-      }
-      // Similar required when loading tracers in loadFixedData
-      if (type == lucTracerType && step() != timestep)
-      {
-        //Change active timestep
-        session.now = now = nearestTimeStep(timestep);
+        reading.emplace_back();
+        more = readGeometryRecord(statement, reading.back(), &keyframes);
+        if (more)
+        {
+          rows++;
+          //Deleted or Skip object? (When noload enabled)
+          DrawingObject* obj = findObject(reading.back().object_id);
+          if (obj && !obj->skip)
+            reading.back().obj = obj;
+        }
+        if (!more || !reading.back().obj)
+        {
+          //Finished, or skipped row
+          reading.pop_back();
+          continue;
+        }
+        batchbytes += reading.back().blob.size();
       }
 
-      if (type == lucTracerType)
+      //Wait for the previous batch to be decompressed
+      if (inflater.joinable()) inflater.join();
+      std::swap(reading, inflating);
+
+      //Start decompressing the new batch in the background
+      if (inflating.size() && workerThreads(threads) > 1)
+        inflater = std::thread(inflateBatch, &inflating);
+      else
+        inflateBatch(&inflating);
+
+      //Load the previous batch in order, while the new batch is decompressed
+      for (auto& record : reading)
       {
-        height = 0;
-        //Default particle count:
-        if (width == 0) width = items;
+        if (record.error)
+          abort_program("uncompress() failed! error code %d\n", record.error);
+        tbytes += record.bytes();   //Byte counter
+        loadGeometryRecord(record, cache);
       }
+      reading.clear();
+    }
+  }
+  catch (...)
+  {
+    //Bad row, wait for the background batch before the error is passed on
+    if (inflater.joinable()) inflater.join();
+    database.release(statement);
+    throw;
+  }
 
-      //Create object and set parameters
-      active = lookupObjectRenderer(obj, type);
+  database.release(statement);
+  debug_print("... loaded %d rows, %ld bytes, %.4lf seconds\n", rows, tbytes, (clock()-t1)/(double)CLOCKS_PER_SEC);
 
-      if (!active) continue; //Can't render this data
+  return rows;
+}
 
-      unsigned char* buffer = NULL;
-      if (bytes != (unsigned int)(count * GeomData::byteSize(data_type)))
+bool Model::readGeometryRecord(sqlite3_stmt* statement, GeometryRecord& record, KeyframeCache* keyframes)
+{
+  //Read the next row into a record, returns false when no rows left
+  //(does not access model data, can be used from loader threads)
+  int ret = sqlite3_step(statement);
+  if (ret != SQLITE_ROW)
+  {
+    if (ret != SQLITE_DONE)
+      fprintf(stderr, "Database file problem, sqlite_step returned: %d (%d)\n", ret, (ret>>8));
+    return false;
+  }
+
+  record.object_id = sqlite3_column_int(statement, 1);
+  record.timestep = sqlite3_column_int(statement, 2);
+  record.height = sqlite3_column_int(statement, 3);  //unused - was rank, now height
+  record.depth = sqlite3_column_int(statement, 4); //unused - was idx, now depth
+  record.type = (lucGeometryType)sqlite3_column_int(statement, 5);
+  record.data_type = (lucGeometryDataType)sqlite3_column_int(statement, 6);
+  record.size = sqlite3_column_int(statement, 7);
+  record.count = sqlite3_column_int(statement, 8);
+  record.items = record.count / record.size;
+  record.width = sqlite3_column_int(statement, 9);
+  if (record.height == 0) record.height = record.width > 0 ? record.items / record.width : 0;
+  record.minimum = (float)sqlite3_column_double(statement, 10);
+  record.maximum = (float)sqlite3_column_double(statement, 11);
+  //Clear if default
+  if (record.maximum - record.minimum == 1.0) record.maximum = record.minimum = 0.0;
+  //Dim factor field repurposed for blob codec
+  sqlite3_int64 codec = sqlite3_column_int64(statement, 12);
+  record.codec = codec & ((1 << GEOM_CODEC_BITS) - 1);
+  //Units field repurposed for data label
+  const char *data_label = (const char*)sqlite3_column_text(statement, 13);
+  const char *labels = (const char*)sqlite3_column_text(statement, 14);
+  if (data_label) record.data_label = data_label;
+  if (labels) record.labels = labels;
+
+  //printf("%d] OBJ %d STEP %d TYPE %d DTYPE %d DIMS (%d x %d x %d) COUNT %d ITEMS %d LABELS %s\n", 
+  //       rows, record.object_id, record.timestep, record.type, record.data_type, record.width, record.height, record.depth, record.count, record.items, labels);
+
+  //Min/max vertex if provided
+  if (sqlite3_column_type(statement, 15) != SQLITE_NULL)
+  {
+    record.bounds = true;
+    for (int i=0; i<3; i++)
+    {
+      record.min[i] = (float)sqlite3_column_double(statement, 15+i);
+      record.max[i] = (float)sqlite3_column_double(statement, 18+i);
+    }
+  }
+
+  //Large rows are left in the database, to be streamed into place when loaded
+  if (sqlite3_column_type(statement, 21) == SQLITE_NULL && sqlite3_column_int64(statement, 22) > 0)
+  {
+    record.rowid = sqlite3_column_int64(statement, 0);
+    record.stream = sqlite3_column_int64(statement, 22);
+    record.source = (const char*)sqlite3_column_text(statement, 23);
+    return true;
+  }
+
+  //Copy the row data, only valid until next step
+  const unsigned char* data = (const unsigned char*)sqlite3_column_blob(statement, 21);
+  unsigned int bytes = sqlite3_column_bytes(statement, 21);
+  record.blob.assign(data, data + bytes);
+
+  //Temporal: read the keyframe row too, to restore the data from when decompressed
+  if (record.codec >= GEOM_CODEC_VERSION && (record.codec & GEOM_CODEC_TEMPORAL))
+    record.keyframe = readKeyframe(sqlite3_db_handle(statement), (const char*)sqlite3_column_text(statement, 23), record, codec, keyframes);
+  return true;
+}
+
+std::shared_ptr<GeometryRecord> Model::readKeyframe(sqlite3* db, const char* source, GeometryRecord& record, sqlite3_int64 codec, KeyframeCache* keyframes)
+{
+  //Keyframe row is found by step offset and ordinal, so survives rows being copied or renumbered
+  //(read once per pass and decompressed here, shared by all records stored relative to it)
+  int offset = (codec >> GEOM_CODEC_BITS) & ((1 << GEOM_KEYFRAME_BITS) - 1);
+  long long ordinal = codec >> (GEOM_CODEC_BITS + GEOM_KEYFRAME_BITS);
+  char SQL[SQL_QUERY_MAX];
+  snprintf(SQL, SQL_QUERY_MAX, "SELECT size,count,data_type,dim_factor,data FROM %sgeometry WHERE timestep=%d AND object_id=%d AND type=%d AND data_type=%d ORDER BY id LIMIT 1 OFFSET %lld",
+           source ? source : "", record.timestep - offset, record.object_id, record.type, record.data_type, ordinal);
+  if (keyframes && keyframes->count(SQL))
+    return (*keyframes)[SQL];
+
+  std::shared_ptr<GeometryRecord> keyframe = std::make_shared<GeometryRecord>();
+  GeometryRecord& key = *keyframe;
+  key.error = -3; //Missing keyframe
+  sqlite3_stmt* keystatement;
+  if (offset > 0 && sqlite3_prepare_v2(db, SQL, -1, &keystatement, NULL) == SQLITE_OK)
+  {
+    if (sqlite3_step(keystatement) == SQLITE_ROW)
+    {
+      key.size = sqlite3_column_int(keystatement, 0);
+      key.count = sqlite3_column_int(keystatement, 1);
+      key.data_type = (lucGeometryDataType)sqlite3_column_int(keystatement, 2);
+      key.codec = sqlite3_column_int(keystatement, 3);
+      const unsigned char* keydata = (const unsigned char*)sqlite3_column_blob(keystatement, 4);
+      key.blob.assign(keydata, keydata + sqlite3_column_bytes(keystatement, 4));
+      key.error = 0;
+      key.inflate();
+    }
+    sqlite3_finalize(keystatement);
+  }
+
+  //Steps merged into the main database from attached timestep files
+  if (key.error == -3 && source && strlen(source))
+    return readKeyframe(db, NULL, record, codec, keyframes);
+
+  if (keyframes) (*keyframes)[SQL] = keyframe;
+  return keyframe;
+}
+
+void Model::loadGeometryRecord(GeometryRecord& record, bool cache)
+{
+  DrawingObject* obj = record.obj;
+  int timestep = record.timestep;
+  lucGeometryType type = record.type;
+  lucGeometryDataType data_type = record.data_type;
+  int width = record.width;
+  int height = record.height;
+  int items = record.items;
+
+  //Bulk load: switch timestep and cache if timestep changes!
+  // - disabled when using attached databases (cached in loop via cacheLoad())
+  if (cache && step() != timestep && !database.attached)
+  {
+    std::cout << '~' << std::flush;
+    if (timestep > 0 && timestep%10==0) std::cout << std::setw(4) << timestep << " " << std::flush;
+    if (timestep > 0 && timestep%50==0) std::cout << std::endl;
+    //Change active timestep
+    session.now = now = nearestTimeStep(timestep);
+    //Flag all data loaded at this step
+    timesteps[now]->loaded = true;
+    timesteps[now]->used = ++accesses;
+    cacheEvict();
+  }
+  // Similar required when loading tracers in loadFixedData
+  if (type == lucTracerType && step() != timestep)
+  {
+    //Change active timestep
+    session.now = now = nearestTimeStep(timestep);
+  }
+
+  if (type == lucTracerType)
+  {
+    height = 0;
+    //Default particle count:
+    if (width == 0) width = items;
+  }
+
+  //Create object and set parameters
+  Geometry* active = lookupObjectRenderer(obj, type);
+
+  if (!active) return; //Can't render this data
+
+  const void* data = record.data();
+
+  //Always add a new element for each new vertex geometry record
+  //not suitable if writing db on multiple procs!
+  if (data_type == lucVertexData) active->add(obj);
+
+  //Read data block
+  Geom_Ptr g;
+  //Convert legacy value types to use data labels
+  switch (data_type)
+  {
+    case lucColourValueData:
+    case lucOpacityValueData:
+    case lucRedValueData:
+    case lucGreenValueData:
+    case lucBlueValueData:
+    case lucXWidthData:
+    case lucYHeightData:
+    case lucZLengthData:
+    case lucSizeData:
+    case lucMaxDataType:
+    {
+      json by;
+      if (record.data_label.length() > 0)
+      {
+        //Use provided label from units field
+        g = active->read(obj, items, data, record.data_label);
+        by = record.data_label;
+      }
+      else //Use default/legacy label
       {
-        //Decompress!
-        unsigned long dst_len = (unsigned long)(count * GeomData::byteSize(data_type));
-        unsigned long uncomp_len = dst_len;
-        unsigned long cmp_len = bytes;
-        buffer = new unsigned char[dst_len];
-        if (!buffer)
-          abort_program("Out of memory!\n");
+        g = active->read(obj, items, data, GeomData::datalabels[data_type]);
+        by = GeomData::datalabels[data_type];
+      }
 
-#ifdef USE_ZLIB
-        int res = uncompress(buffer, &uncomp_len, (const unsigned char *)data, cmp_len);
-        if (res != Z_OK || dst_len != uncomp_len)
-#else
-        int res = tinfl_decompress_mem_to_mem(buffer, uncomp_len, (const unsigned char *)data, cmp_len, TINFL_FLAG_PARSE_ZLIB_HEADER);
-        if (!res)
-#endif
-        {
-          abort_program("uncompress() failed! error code %d\n", res);
-          //abort_program("uncompress() failed! error code %d expected size %d actual size %d\n", res, dst_len, uncomp_len);
-        }
-        data = buffer; //Replace data pointer
-        bytes = uncomp_len;
+      //Set as the opacity/size data if in these categories
+      if (data_type == lucOpacityValueData)
+        obj->properties.data["opacityby"] = by;
+      if (data_type == lucSizeData)
+        obj->properties.data["sizeby"] = by;
+
+      //copy max/min fields
+      unsigned int valueIdx = g->valuesLookup(by);
+      if (valueIdx < g->values.size())
+      {
+        if (record.stream)
+          streamGeometryRecord(record, g->values[valueIdx].get(), items);
+        g->values[valueIdx]->minimum = record.minimum;
+        g->values[valueIdx]->maximum = record.maximum;
       }
+      break;
+    }
+    default:
+      //Non-value data
+      g = active->read(obj, items, data_type, data, width, height, record.depth);
 
-      tbytes += bytes;   //Byte counter
+      //copy max/min fields
+      Data_Ptr container = g->dataContainer(data_type);
+      if (record.stream)
+        streamGeometryRecord(record, container.get(), items);
+      container->minimum = record.minimum;
+      container->maximum = record.maximum;
+  }
 
-      //Always add a new element for each new vertex geometry record
-      //not suitable if writing db on multiple procs!
-      if (data_type == lucVertexData) active->add(obj);
+  //Set geom labels if any
+  if (record.labels.length()) active->label(obj, record.labels.c_str());
 
-      //Read data block
-      Geom_Ptr g;
-      //Convert legacy value types to use data labels
-      switch (data_type)
-      {
-        case lucColourValueData:
-        case lucOpacityValueData:
-        case lucRedValueData:
-        case lucGreenValueData:
-        case lucBlueValueData:
-        case lucXWidthData:
-        case lucYHeightData:
-        case lucZLengthData:
-        case lucSizeData:
-        case lucMaxDataType:
-        {
-          json by;
-          if (data_label && strlen(data_label) > 0)
-          {
-            //Use provided label from units field
-            g = active->read(obj, items, data, data_label);
-            by = data_label;
-          }
-          else //Use default/legacy label
-          {
-            g = active->read(obj, items, data, GeomData::datalabels[data_type]);
-            by = GeomData::datalabels[data_type];
-          }
+  //Where min/max vertex provided, load
+  if (data_type == lucVertexData && type != lucLabelType && record.bounds)
+  {
+    //Apply dims if provided
+    float* min = record.min;
+    float* max = record.max;
+    if (min[0] != max[0] || min[1] != max[1] || min[2] != max[2])
+    {
+      g->checkPointMinMax(min);
+      g->checkPointMinMax(max);
+    }
+  }
 
-          //Set as the opacity/size data if in these categories
-          if (data_type == lucOpacityValueData)
-            obj->properties.data["opacityby"] = by;
-          if (data_type == lucSizeData)
-            obj->properties.data["sizeby"] = by;
+  //Release the row data
+  std::vector<unsigned char>().swap(record.blob);
+  std::vector<unsigned char>().swap(record.buffer);
+}
 
-          //copy max/min fields
-          unsigned int valueIdx = g->valuesLookup(by);
-          if (valueIdx < g->values.size())
-          {
-            g->values[valueIdx]->minimum = minimum;
-            g->values[valueIdx]->maximum = maximum;
-          }
-          break;
-        }
-        default:
-          //Non-value data
-          g = active->read(obj, items, data_type, data, width, height, depth);
-
-          //copy max/min fields
-          Data_Ptr container = g->dataContainer(data_type);
-          container->minimum = minimum;
-          container->maximum = maximum;
+void Model::streamGeometryRecord(GeometryRecord& record, DataContainer* container, unsigned int items)
+{
+  //Read a large row from the database directly into the space allocated for it
+  //at the end of the container, decompressing in chunks, no copy of the row is held
+  unsigned int count = items * container->unitsize();
+  if (count == 0 || container->size() < count) return;
+  unsigned char* dest = (unsigned char*)container->ref(container->size() - count);
+  unsigned int dst_len = count * GeomData::byteSize(record.data_type);
+
+  char dbname[32] = "main";
+  if (record.source.length()) snprintf(dbname, 32, "%s", record.source.substr(0, record.source.length()-1).c_str());
+  sqlite3_blob* blob;
+  if (sqlite3_blob_open(database.db, dbname, "geometry", "data", record.rowid, 0, &blob) != SQLITE_OK)
+    abort_program("SQL blob open error: %s\n", sqlite3_errmsg(database.db));
+  int stored = sqlite3_blob_bytes(blob);
+
+  if (stored == (int)(record.count * GeomData::byteSize(record.data_type)))
+  {
+    //Uncompressed
+    if (sqlite3_blob_read(blob, dest, std::min(stored, (int)dst_len), 0) != SQLITE_OK)
+      abort_program("SQL blob read error: %s\n", sqlite3_errmsg(database.db));
+  }
+  else
+  {
+    z_stream strm;
+    memset(&strm, 0, sizeof(z_stream));
+    int res = inflateInit(&strm);
+    std::vector<unsigned char> chunk(GEOM_STREAM_CHUNK);
+    strm.next_out = dest;
+    strm.avail_out = dst_len;
+    int offset = 0;
+    while (res == Z_OK && offset < stored && strm.avail_out > 0)
+    {
+      int len = std::min(stored - offset, GEOM_STREAM_CHUNK);
+      if (sqlite3_blob_read(blob, chunk.data(), len, offset) != SQLITE_OK)
+        abort_program("SQL blob read error: %s\n", sqlite3_errmsg(database.db));
+      offset += len;
+      strm.next_in = chunk.data();
+      strm.avail_in = len;
+      res = inflate(&strm, Z_NO_FLUSH);
+    }
+    inflateEnd(&strm);
+    if ((res != Z_OK && res != Z_STREAM_END) || strm.total_out != dst_len)
+      abort_program("inflate() failed! error code %d\n", res);
+  }
+
+  sqlite3_blob_close(blob);
+}
+
+void Model::prefetch(int stepidx)
+{
+  //Read and decompress the geometry of the steps following stepidx in a background thread,
+  //ready to be loaded when the timestep changes (number of steps set by "prefetch" property)
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+  return;
+#endif
+  int ahead = session.global("prefetch");
+  if (ahead <= 0 || !database || database.memory || session.global("cache")) return;
+
+  //Queue upcoming steps that are not already in memory or loaded
+  bool clear = session.global("clearstep");
+  std::vector<int> steps;
+  std::vector<std::string> paths;
+  for (int idx = stepidx+1; idx <= stepidx+ahead && idx < (int)timesteps.size(); idx++)
+  {
+    if (timesteps[idx]->loaded && !clear) continue;
+    steps.push_back(timesteps[idx]->step);
+    paths.push_back(timesteps[idx]->path.length() ? timesteps[idx]->path : database.file.full);
+  }
+
+  {
+    //Discard any loaded steps no longer in range
+    LOCK_GUARD(prefetch_mutex);
+    for (auto it = prefetched.begin(); it != prefetched.end(); )
+    {
+      if (std::find(steps.begin(), steps.end(), it->first) == steps.end())
+        it = prefetched.erase(it);
+      else
+        ++it;
+    }
+    //Abandon the step being read if no longer wanted
+    if (prefetch_loading >= 0 && std::find(steps.begin(), steps.end(), prefetch_loading) == steps.end())
+      prefetch_cancel = true;
+    //Skip steps already loaded or being read
+    for (int i = steps.size()-1; i >= 0; i--)
+    {
+      if (prefetched.find(steps[i]) != prefetched.end() || (steps[i] == prefetch_loading && !prefetch_cancel))
+      {
+        steps.erase(steps.begin()+i);
+        paths.erase(paths.begin()+i);
       }
+    }
+    //Replace the queue, the loader picks up new requests as it finishes each step
+    prefetch_steps = steps;
+    prefetch_paths = paths;
+    prefetch_db = database.file.full;
+    prefetch_threads = session.global("threads");
+  }
 
-      //Set geom labels if any
-      if (labels) active->label(obj, labels);
+  if (steps.size() == 0) return;
+  prefetch_cv.notify_one();
+  if (prefetch_thread.joinable()) return;
 
-      //Where min/max vertex provided, load
-      if (data_type == lucVertexData && type != lucLabelType)
+  //Start the loader, runs until the model is deleted
+  prefetch_thread = std::thread([this]()
+  {
+    std::unique_lock<std::mutex> lock(prefetch_mutex);
+    while (true)
+    {
+      prefetch_cv.wait(lock, [this]{return prefetch_quit || prefetch_steps.size();});
+      if (prefetch_quit) break;
+      int step = prefetch_steps.front();
+      std::string path = prefetch_paths.front();
+      prefetch_steps.erase(prefetch_steps.begin());
+      prefetch_paths.erase(prefetch_paths.begin());
+      prefetch_loading = step;
+      prefetch_cancel = false;
+      bool main = path == prefetch_db;
+      int threads = prefetch_threads;
+      lock.unlock();
+
+      //Use a separate connection, data is read from the step database directly when split into files
+      std::vector<GeometryRecord> records;
+      FilePath fp(path);
+      Database db(fp);
+      sqlite3_stmt* statement = NULL;
+      if (db.open())
+      {
+        char filter[256];
+        if (main)
+          sprintf(filter, "type != %d AND timestep=%d", lucTracerType, step);
+        else
+          sprintf(filter, "type != %d", lucTracerType);
+        statement = selectGeometry(db, filter, false);
+      }
+      if (statement)
       {
-        float min[3] = {0,0,0}, max[3] = {0,0,0};
-        if (sqlite3_column_type(statement, 15) != SQLITE_NULL)
+        KeyframeCache keyframes;
+        do
         {
-          for (int i=0; i<3; i++)
-          {
-            min[i] = (float)sqlite3_column_double(statement, 15+i);
-            max[i] = (float)sqlite3_column_double(statement, 18+i);
-          }
+          records.emplace_back();
         }
+        while (!prefetch_cancel && readGeometryRecord(statement, records.back(), &keyframes));
+        records.pop_back();
+        sqlite3_finalize(statement);
 
-        //Apply dims if provided
-        if (min[0] != max[0] || min[1] != max[1] || min[2] != max[2])
-        {
-          g->checkPointMinMax(min);
-          g->checkPointMinMax(max);
-        }
+        if (!prefetch_cancel)
+          parallelTasks(records.size(), threads, [&records](size_t i) {records[i].inflate();});
       }
 
-      if (buffer) delete[] buffer;
+      lock.lock();
+      if (statement && !prefetch_cancel)
+      {
+        debug_print("Prefetched %d records for step %d\n", (int)records.size(), step);
+        prefetched[step] = std::move(records);
+      }
+      prefetch_loading = -1;
+      prefetch_cv.notify_all();
     }
-    else if (ret != SQLITE_DONE)
-      fprintf(stderr, "Database file problem, sqlite_step returned: %d (%d)\n", ret, (ret>>8));
-  }
-  while (ret == SQLITE_ROW);
+  });
+}
 
-  sqlite3_finalize(statement);
-  debug_print("... loaded %d rows, %d bytes, %.4lf seconds\n", rows, tbytes, (clock()-t1)/(double)CLOCKS_PER_SEC);
+int Model::loadPrefetched(int step)
+{
+  //Load the records for a step from the background loader, returns -1 if not available
+  std::vector<GeometryRecord> records;
+  {
+    std::unique_lock<std::mutex> lock(prefetch_mutex);
+    //Still being read, wait for this step only
+    prefetch_cv.wait(lock, [&]{return prefetch_loading != step;});
+    auto it = prefetched.find(step);
+    if (it == prefetched.end())
+    {
+      //Not loaded, stop reading others, the queue is replaced when prefetching from this step
+      if (prefetch_loading >= 0) prefetch_cancel = true;
+      prefetch_steps.clear();
+      prefetch_paths.clear();
+      return -1;
+    }
+    records = std::move(it->second);
+    prefetched.erase(it);
+  }
 
+  int rows = 0;
+  for (auto& record : records)
+  {
+    //Deleted or Skip object? (When noload enabled)
+    record.obj = findObject(record.object_id);
+    if (!record.obj || record.obj->skip) continue;
+    if (record.error)
+      abort_program("uncompress() failed! error code %d\n", record.error);
+    loadGeometryRecord(record, true);
+    rows++;
+  }
+  debug_print("... loaded %d prefetched rows for step %d\n", rows, step);
   return rows;
 }
 
+void Model::clearPrefetch()
+{
+  //Discard loaded data and queued steps, waits for the loader to abandon any step being read
+  std::unique_lock<std::mutex> lock(prefetch_mutex);
+  prefetch_steps.clear();
+  prefetch_paths.clear();
+  prefetch_cancel = true;
+  prefetch_cv.wait(lock, [this]{return prefetch_loading < 0;});
+  prefetched.clear();
+}
+
 void Model::mergeDatabases()
 {
   if (!database || !database.attached) return;
@@ -1797,7 +2392,8 @@ void Model::mergeDatabases()
     setTimeStep(i);
     if (database.attached->step == step())
     {
-      database.issue("INSERT INTO geometry select null, object_id, timestep, rank, idx, type, data_type, size, count, width, minimum, maximum, dim_factor, units, labels, properties, data, minX, minY, minZ, maxX, maxY, maxZ FROM %sgeometry", database.prefix);
+      //(in row order, temporal rows find their keyframe by position)
+      database.issue("INSERT INTO geometry select null, object_id, timestep, rank, idx, type, data_type, size, count, width, minimum, maximum, dim_factor, units, labels, properties, data, minX, minY, minZ, maxX, maxY, maxZ FROM %sgeometry ORDER BY id", database.prefix);
     }
   }
 }
@@ -1862,13 +2458,15 @@ void Model::updateObject(DrawingObject* target, lucGeometryType type)
 {
   database.reopen(true); //Ensure opened writable
   database.issue("BEGIN EXCLUSIVE TRANSACTION");
+  GeometryWriter writer(database, session.global("compression"), session.global("compressfilter"), session.global("quantize"), session.global("threads"));
   if (type == lucMaxType)
-    writeObjects(database, target, step());
+    writeObjects(writer, target, step());
   else
   {
     Geometry* g = getRenderer(type);
-    if (g) writeGeometry(database, g, target, step());
+    if (g) writeGeometry(writer, g, target, step());
   }
+  writer.flush();
 
   //Update object
   database.issue("UPDATE OBJECT set properties = '%s' WHERE name = '%s'", target->properties.data.dump().c_str(), target->name().c_str());
@@ -1911,6 +2509,8 @@ void Model::writeDatabase(const char* path, DrawingObject* obj, bool overwrite)
   }
   else
   {
+    //Any prefetched data will be out of date
+    clearPrefetch();
     database.reopen(true);  //Open writable
     writeDatabase(database, obj);
   }
@@ -1926,7 +2526,7 @@ void Model::writeDatabase(Database& outdb, DrawingObject* obj)
   outdb.issue("CREATE TABLE IF NOT EXISTS geometry (id INTEGER PRIMARY KEY ASC, object_id INTEGER, timestep INTEGER, rank INTEGER, idx INTEGER, type INTEGER, data_type INTEGER, size INTEGER, count INTEGER, width INTEGER, minimum REAL, maximum REAL, dim_factor REAL, units VARCHAR(32), minX REAL, minY REAL, minZ REAL, maxX REAL, maxY REAL, maxZ REAL, labels VARCHAR(2048), properties VARCHAR(2048), data BLOB, FOREIGN KEY (object_id) REFERENCES object (id) ON DELETE CASCADE ON UPDATE CASCADE, FOREIGN KEY (timestep) REFERENCES timestep (id) ON DELETE CASCADE ON UPDATE CASCADE)");
 
   //Index for more efficient geometry queries (and avoids writing temp index files)
-  outdb.issue("CREATE INDEX IF NOT EXISTS idx_timestep_object ON geometry (timestep,object_id)");
+  outdb.issue("CREATE INDEX IF NOT EXISTS idx_timestep_object_type ON geometry (timestep,object_id,type)");
 
   outdb.issue("CREATE TABLE IF NOT EXISTS timestep (id INTEGER PRIMARY KEY ASC, time REAL, dim_factor REAL, units VARCHAR(32), properties VARCHAR(2048))");
 
@@ -1950,9 +2550,11 @@ void Model::writeDatabase(Database& outdb, DrawingObject* obj)
   }
 
   //Write timesteps & objects...
+  GeometryWriter writer(outdb, session.global("compression"), session.global("compressfilter"), session.global("quantize"), session.global("threads"));
+  writer.keyframes = session.global("keyframes");
 
   //Write any fixed data
-  writeObjects(outdb, obj, -1);
+  writeObjects(writer, obj, -1);
 
   for (unsigned int i = 0; i < timesteps.size(); i++)
   {
@@ -1965,9 +2567,10 @@ void Model::writeDatabase(Database& outdb, DrawingObject* obj)
     //setTimeStep(i);
 
     //Write object data
-    writeObjects(outdb, obj, i);
+    writeObjects(writer, obj, i);
   }
 
+  writer.flush();
   outdb.issue("COMMIT");
 }
 
@@ -2006,7 +2609,7 @@ void Model::writeState(Database& outdb)
   }
 }
 
-void Model::writeObjects(Database& outdb, DrawingObject* obj, int step)
+void Model::writeObjects(GeometryWriter& writer, DrawingObject* obj, int step)
 {
   //Write object data
   for (unsigned int i=0; i < objects.size(); i++)
@@ -2016,20 +2619,27 @@ void Model::writeObjects(Database& outdb, DrawingObject* obj, int step)
       //Loop through all geometry classes (points/vectors etc)
       for (auto g : geometry)
       {
-        writeGeometry(outdb, g, objects[i], step);
+        writeGeometry(writer, g, objects[i], step);
       }
     }
   }
 }
 
-void Model::deleteGeometry(Database& outdb, lucGeometryType type, DrawingObject* obj, int step)
+void Model::deleteGeometry(GeometryWriter& writer, lucGeometryType type, DrawingObject* obj, int step)
 {
   //Clear existing data of this type before writing, allows object update to db
   if (obj->dbid > 0)
-    outdb.issue("DELETE FROM geometry WHERE object_id=%d and type=%d and timestep=%d;", obj->dbid, type, step);
+  {
+    GeometryBlock del;
+    del.erase = true;
+    del.objid = obj->dbid;
+    del.type = type;
+    del.step = step;
+    writer.write(del);
+  }
 }
 
-void Model::writeGeometry(Database& outdb, Geometry* g, DrawingObject* obj, int step)
+void Model::writeGeometry(GeometryWriter& writer, Geometry* g, DrawingObject* obj, int step)
 {
   //Get data
   std::vector<Geom_Ptr> data = g->getAllObjectsAt(obj, step);
@@ -2038,7 +2648,13 @@ void Model::writeGeometry(Database& outdb, Geometry* g, DrawingObject* obj, int
   if (data.size() < 1) return;
 
   //Clear existing data of this type before writing, allows object data updates to db
-  deleteGeometry(outdb, g->type, obj, step);
+  deleteGeometry(writer, g->type, obj, step);
+
+  //Temporal encoding, steps between keyframes are stored as the difference
+  //from matching data of the same size at the previous keyframe step
+  std::vector<Geom_Ptr> keydata;
+  if (writer.keyframes > 1 && writer.keyframes <= (1 << GEOM_KEYFRAME_BITS) && step > 0 && step % writer.keyframes && g->type != lucTracerType)
+    keydata = g->getAllObjectsAt(obj, step - step % writer.keyframes);
 
   //Loop through and write out all object data
   for (unsigned int i=0; i<data.size(); i++)
@@ -2050,7 +2666,9 @@ void Model::writeGeometry(Database& outdb, Geometry* g, DrawingObject* obj, int
       if (!block || block->size() == 0) continue;
       if (infostream) std::cerr << step << "] Writing geometry (type[" << data_type << "] * " << block->size()
                 << ") for object : " << obj->dbid << " => " << obj->name() << std::endl;
-      writeGeometryRecord(outdb, g->type, (lucGeometryDataType)data_type, obj->dbid, data[i], block.get(), step);
+      Data_Ptr key = i < keydata.size() ? keydata[i]->dataContainer((lucGeometryDataType)data_type) : nullptr;
+      if (key && key->bytes() != block->bytes()) key = nullptr;
+      writeGeometryRecord(writer, g->type, (lucGeometryDataType)data_type, obj->dbid, data[i], block.get(), step, key.get());
 
       /*/TODO: Has texture? write as values/rgba?
       //if (g->hasTexture()
@@ -2071,98 +2689,476 @@ void Model::writeGeometry(Database& outdb, Geometry* g, DrawingObject* obj, int
       //Filters and colourby properties will need modification though
       unsigned int data_type = lucColourValueData+j;
       if (data_type == lucIndexData) data_type++;
-      writeGeometryRecord(outdb, g->type, (lucGeometryDataType)data_type, obj->dbid, data[i], block, step);
+      DataContainer* key = NULL;
+      if (i < keydata.size() && j < keydata[i]->values.size() && keydata[i]->values[j]->label == block->label)
+        key = keydata[i]->values[j].get();
+      if (key && key->bytes() != block->bytes()) key = NULL;
+      writeGeometryRecord(writer, g->type, (lucGeometryDataType)data_type, obj->dbid, data[i], block, step, key);
     }
   }
 }
 
-void Model::writeGeometryRecord(Database& outdb, lucGeometryType type, lucGeometryDataType dtype, unsigned int objid, Geom_Ptr data, DataContainer* block, int step)
+void Model::writeGeometryRecord(GeometryWriter& writer, lucGeometryType type, lucGeometryDataType dtype, unsigned int objid, Geom_Ptr data, DataContainer* block, int step, DataContainer* reference)
 {
-  int compression = session.global("compression");
-  char SQL[SQL_QUERY_MAX];
-  sqlite3_stmt* statement;
-  unsigned char* buffer = (unsigned char*)block->ref(0);
-  unsigned long src_len = block->bytes();
-  // Compress the data if enabled and > 1kb
-  unsigned long cmp_len = 0;
-  if (compression != Z_NO_COMPRESSION &&  src_len > 1000)
-  {
-    cmp_len = compressBound(src_len);
-    buffer = (unsigned char*)malloc((size_t)cmp_len);
-    if (buffer == NULL)
-      abort_program("Compress database: out of memory!\n");
-    //if (compress(buffer, &cmp_len, (const unsigned char *)block->ref(0), src_len) != Z_OK)
-    if (compress2(buffer, &cmp_len, (const unsigned char *)block->ref(0), src_len, compression) != Z_OK)
-      abort_program("Compress database buffer failed!\n");
-    if (cmp_len >= src_len)
-    {
-      free(buffer);
-      buffer = (unsigned char*)block->ref(0);
-      cmp_len = 0;
-    }
-    else
-      src_len = cmp_len;
-  }
-
   if (block->minimum == HUGE_VAL || std::isnan(block->minimum)) block->minimum = 0;
   if (block->maximum == -HUGE_VAL || std::isnan(block->maximum)) block->maximum = 0;
 
-  float min[3], max[3];
+  GeometryBlock record;
+  record.objid = objid;
+  record.step = step;
+  record.type = type;
+  record.dtype = dtype;
+  record.unitsize = block->unitsize();
+  record.count = block->size();
+  record.minimum = block->minimum;
+  record.maximum = block->maximum;
+  record.label = block->label;
+  record.src = (const unsigned char*)block->ref(0);
+  record.src_len = block->bytes();
+  if (reference) record.reference = (const unsigned char*)reference->ref(0);
+
   for (int c=0; c<3; c++)
   {
-    min[c] = data->min[c];
-    if (!std::isfinite(min[c])) min[c] = session.min[c];
-    if (!std::isfinite(min[c])) min[c] = 0.0;
-    max[c] = data->max[c];
-    if (!std::isfinite(max[c])) max[c] = session.max[c];
-    if (!std::isfinite(max[c])) max[c] = 0.0;
+    record.min[c] = data->min[c];
+    if (!std::isfinite(record.min[c])) record.min[c] = session.min[c];
+    if (!std::isfinite(record.min[c])) record.min[c] = 0.0;
+    record.max[c] = data->max[c];
+    if (!std::isfinite(record.max[c])) record.max[c] = session.max[c];
+    if (!std::isfinite(record.max[c])) record.max[c] = 0.0;
   }
 
   //Use texwidth/height if RGB/RGBA data
-  int width = data->width;
-  int height = data->height;
-  int depth = data->depth;
+  record.width = data->width;
+  record.height = data->height;
+  record.depth = data->depth;
   if (dtype == lucRGBData || dtype == lucRGBAData)
   {
-    width = data->texwidth;
-    height = data->texheight;
-    depth = dtype == lucRGBData ? 3 : 4;
+    record.width = data->texwidth;
+    record.height = data->texheight;
+    record.depth = dtype == lucRGBData ? 3 : 4;
   }
 
-  snprintf(SQL, SQL_QUERY_MAX, "INSERT INTO geometry (object_id, timestep, rank, idx, type, data_type, size, count, width, minimum, maximum, dim_factor, units, minX, minY, minZ, maxX, maxY, maxZ, labels, data) VALUES (%d, %d, %d, %d, %d, %d, %d, %d, %d, %g, %g, %g, '%s', %g, %g, %g, %g, %g, %g, ?, ?)", objid, step, height, depth, type, dtype, block->unitsize(), block->size(), width, block->minimum, block->maximum, 0.0, block->label.c_str(), min[0], min[1], min[2], max[0], max[1], max[2]);
+  //Text labels (on vertex block only)
+  if (dtype == lucVertexData)
+    record.labels = data->getLabels();
 
-  /* Prepare statement... */
-  if (sqlite3_prepare_v2(outdb.db, SQL, -1, &statement, NULL) != SQLITE_OK)
+  writer.write(record);
+
+  //printf("WROTE ID %d STEP %d TYPE %d DTYPE %d DIMS (%d x %d x %d) COUNT %d LABELS %s\n", 
+  //       objid, step, type, dtype, data->width, data->height, data->depth, block->size(), record.labels.c_str());
+}
+
+//Limits on blocks and data queued before compressing
+#define GEOM_WRITE_BLOCKS 1024
+#define GEOM_WRITE_BYTES 64000000
+
+template <typename T>
+void deltaEncode(T* values, unsigned int count, unsigned int stride)
+{
+  for (unsigned int i = count; i-- > stride; )
+    values[i] -= values[i-stride];
+}
+
+template <typename T>
+void deltaDecode(T* values, unsigned int count, unsigned int stride)
+{
+  for (unsigned int i = stride; i < count; i++)
+    values[i] += values[i-stride];
+}
+
+void geometryEncode(unsigned char* data, unsigned int bytes, unsigned int elsize, unsigned int stride, int codec)
+{
+  //Filter blob data in place to improve compression
+  //Delta is applied to the bit patterns as integers so it is lossless for float data
+  unsigned int count = elsize ? bytes / elsize : 0;
+  if ((codec & GEOM_CODEC_DELTA) && stride > 0)
   {
-    abort_program("SQL prepare error: (%s) %s\n", SQL, sqlite3_errmsg(outdb.db));
+    if (elsize == 4) deltaEncode((uint32_t*)data, count, stride);
+    else if (elsize == 2) deltaEncode((uint16_t*)data, count, stride);
   }
+  if ((codec & GEOM_CODEC_SHUFFLE) && elsize > 1)
+  {
+    std::vector<unsigned char> src(data, data + count * elsize);
+    for (unsigned int i = 0; i < count; i++)
+      for (unsigned int b = 0; b < elsize; b++)
+        data[b * count + i] = src[i * elsize + b];
+  }
+}
 
-  /* Setup text data for insert (on vertex block only) */
-  std::string labels = data->getLabels().c_str();
-  if (dtype == lucVertexData && labels.length() > 0)
+void geometryDecode(unsigned char* data, unsigned int bytes, unsigned int elsize, unsigned int stride, int codec)
+{
+  //Reverse geometryEncode filters in place
+  unsigned int count = elsize ? bytes / elsize : 0;
+  if ((codec & GEOM_CODEC_SHUFFLE) && elsize > 1)
   {
-    if (sqlite3_bind_text(statement, 1, labels.c_str(), labels.length(), SQLITE_STATIC) != SQLITE_OK)
-    //const char* clabels = labels.c_str();
-    //if (sqlite3_bind_text(statement, 1, clabels, strlen(clabels), SQLITE_STATIC) != SQLITE_OK)
-      abort_program("SQL bind error: %s\n", sqlite3_errmsg(outdb.db));
+    std::vector<unsigned char> src(data, data + count * elsize);
+    for (unsigned int i = 0; i < count; i++)
+      for (unsigned int b = 0; b < elsize; b++)
+        data[i * elsize + b] = src[b * count + i];
   }
+  if ((codec & GEOM_CODEC_DELTA) && stride > 0)
+  {
+    if (elsize == 4) deltaDecode((uint32_t*)data, count, stride);
+    else if (elsize == 2) deltaDecode((uint16_t*)data, count, stride);
+  }
+}
+
+unsigned int geometryQuantizeBits(lucGeometryDataType type, int quantize)
+{
+  //Bits to store float data type with when quantizing enabled
+  //(16 bit for positions and directions, 8 or 16 for values, texture coords and integer types never quantized)
+  if (quantize <= 0 || GeomData::byteSize(type) != sizeof(float) || type == lucIndexData || type == lucTexCoordData || type == lucRGBAData)
+    return 0;
+  if (type == lucVertexData || type == lucNormalData || type == lucVectorData)
+    return 16;
+  return quantize <= 8 ? 8 : 16;
+}
+
+void geometryQuantize(const float* values, unsigned int count, unsigned int stride, unsigned int bytes, std::vector<unsigned char>& out)
+{
+  //Header of min/max range of each component, followed by values scaled to integers within range
+  //Maximum error is half of range / (2^bits - 2), highest integer is reserved for non-finite values
+  std::vector<float> range(stride * 2);
+  for (unsigned int c = 0; c < stride; c++)
+  {
+    range[c*2] = HUGE_VALF;
+    range[c*2+1] = -HUGE_VALF;
+  }
+  for (unsigned int i = 0; i < count; i++)
+  {
+    unsigned int c = i % stride;
+    if (!std::isfinite(values[i])) continue;
+    if (values[i] < range[c*2]) range[c*2] = values[i];
+    if (values[i] > range[c*2+1]) range[c*2+1] = values[i];
+  }
+  for (unsigned int c = 0; c < stride; c++)
+    if (range[c*2] > range[c*2+1]) range[c*2] = range[c*2+1] = 0;
+
+  unsigned int header = stride * 2 * sizeof(float);
+  unsigned int levels = (1 << (bytes * 8)) - 2;
+  out.resize(header + count * bytes);
+  memcpy(out.data(), range.data(), header);
+  unsigned char* codes = out.data() + header;
+  for (unsigned int i = 0; i < count; i++)
+  {
+    unsigned int c = i % stride;
+    double r = (double)range[c*2+1] - range[c*2];
+    unsigned int q = levels + 1;
+    if (std::isfinite(values[i]))
+      q = r > 0 ? (unsigned int)((values[i] - range[c*2]) / r * levels + 0.5) : 0;
+    if (bytes == 1)
+      codes[i] = q;
+    else
+      ((uint16_t*)codes)[i] = q;
+  }
+}
+
+void geometryDequantize(const unsigned char* data, unsigned int count, unsigned int stride, unsigned int bytes, float* out)
+{
+  //Expand quantized values back to float
+  const float* range = (const float*)data;
+  const unsigned char* codes = data + stride * 2 * sizeof(float);
+  unsigned int levels = (1 << (bytes * 8)) - 2;
+  for (unsigned int i = 0; i < count; i++)
+  {
+    unsigned int c = i % stride;
+    unsigned int q = bytes == 1 ? codes[i] : ((const uint16_t*)codes)[i];
+    if (q > levels)
+      out[i] = NAN;
+    else
+      out[i] = (float)(range[c*2] + q * (((double)range[c*2+1] - range[c*2]) / levels));
+  }
+}
+
+void GeometryBlock::compress(int level, int filter, int quantize)
+{
+  // Compress the data if enabled and > 1kb
+  // (quantized data is always stored compressed, level 0 just wraps it in a zlib stream)
+  unsigned int qbits = unitsize > 0 ? geometryQuantizeBits(dtype, quantize) : 0;
+  if (erase || (level == Z_NO_COMPRESSION && !qbits) || src_len <= 1000) return;
+
+  //Temporal data is stored as the difference from keyframe data (not with quantized data)
+  bool temporal = reference && !qbits;
+
+  //Quantize float data within range of each component
+  const unsigned char* input = src;
+  unsigned long input_len = src_len;
+  std::vector<unsigned char> filtered;
+  unsigned int elsize = GeomData::byteSize(dtype);
+  unsigned int header = 0;
+  if (temporal)
+  {
+    //Unchanged bits between steps become zero
+    codec = GEOM_CODEC_VERSION | GEOM_CODEC_TEMPORAL;
+    filtered.resize(src_len);
+    for (unsigned long i=0; i<src_len; i++)
+      filtered[i] = src[i] ^ reference[i];
+  }
+  else if (qbits)
+  {
+    codec = GEOM_CODEC_VERSION | (qbits == 8 ? GEOM_CODEC_QUANT8 : GEOM_CODEC_QUANT16);
+    geometryQuantize((const float*)src, src_len / sizeof(float), unitsize, qbits / 8, filtered);
+    header = unitsize * 2 * sizeof(float);
+    elsize = qbits / 8;
+  }
+
+  //Pre-compression filter
+  //(1 = byte shuffle, 2 = byte shuffle and delta)
+  if (filter > 0 && elsize > 1)
+  {
+    codec |= GEOM_CODEC_VERSION | GEOM_CODEC_SHUFFLE;
+    if (filter > 1) codec |= GEOM_CODEC_DELTA;
+    if (!filtered.size()) filtered.assign(src, src + src_len);
+    geometryEncode(filtered.data() + header, filtered.size() - header, elsize, unitsize, codec);
+  }
+
+  if (filtered.size())
+  {
+    input = filtered.data();
+    input_len = filtered.size();
+  }
+
+  unsigned long cmp_len = compressBound(input_len);
+  compressed.resize(cmp_len);
+  //if (compress(buffer, &cmp_len, src, src_len) != Z_OK)
+  if (compress2(compressed.data(), &cmp_len, input, input_len, level) != Z_OK)
+  {
+    error = 1;
+    return;
+  }
+  //No gain, store uncompressed
+  if (cmp_len >= src_len)
+  {
+    compressed.clear();
+    codec = 0;
+  }
+  else
+    compressed.resize(cmp_len);
+}
+
+GeometryWriter::GeometryWriter(Database& db, int compression, int filter, int quantize, int threads) : db(db), compression(compression), filter(filter), quantize(quantize), threads(threads)
+{
+}
+
+GeometryWriter::~GeometryWriter()
+{
+  if (compressor.joinable()) compressor.join();
+  if (insert) sqlite3_finalize(insert);
+  if (erase) sqlite3_finalize(erase);
+}
+
+void GeometryWriter::write(GeometryBlock& block)
+{
+  //Queue the block, compress and write when enough data queued
+  queuedbytes += block.src_len;
+  queued.push_back(std::move(block));
+  if (queued.size() >= GEOM_WRITE_BLOCKS || queuedbytes >= GEOM_WRITE_BYTES)
+    next();
+}
+
+void GeometryWriter::flush()
+{
+  //Write all queued blocks
+  next();
+  next();
+}
+
+void GeometryWriter::next()
+{
+  //Wait for the previous batch to be compressed
+  if (compressor.joinable()) compressor.join();
+  std::swap(queued, compressing);
+  queuedbytes = 0;
+
+  //Start compressing the new batch in the background
+  auto compressBatch = [](std::vector<GeometryBlock>* batch, int level, int filter, int quantize, int threads)
+  {
+    parallelTasks(batch->size(), threads, [=](size_t i) {(*batch)[i].compress(level, filter, quantize);});
+  };
+  if (compressing.size() && workerThreads(threads) > 1)
+    compressor = std::thread(compressBatch, &compressing, compression, filter, quantize, threads);
+  else
+    compressBatch(&compressing, compression, filter, quantize, threads);
+
+  //Write the previous batch in order
+  for (auto& block : queued)
+    store(block);
+  queued.clear();
+}
+
+void GeometryWriter::store(GeometryBlock& block)
+{
+  if (block.erase)
+  {
+    //Rows stored relative to the data being deleted must be restored first
+    if (temporal < 0)
+    {
+      sqlite3_stmt* statement = db.select("SELECT id FROM geometry WHERE dim_factor >= %d LIMIT 1", 1 << GEOM_CODEC_BITS);
+      temporal = statement && sqlite3_step(statement) == SQLITE_ROW;
+      if (statement) sqlite3_finalize(statement);
+    }
+    if (temporal)
+      restore(block);
+
+    if (!erase && sqlite3_prepare_v2(db.db, "DELETE FROM geometry WHERE object_id=? and type=? and timestep=?", -1, &erase, NULL) != SQLITE_OK)
+      abort_program("SQL prepare error: %s\n", sqlite3_errmsg(db.db));
+    sqlite3_bind_int(erase, 1, block.objid);
+    sqlite3_bind_int(erase, 2, block.type);
+    sqlite3_bind_int(erase, 3, block.step);
+    if (sqlite3_step(erase) != SQLITE_DONE)
+      abort_program("SQL step error: (delete) %s\n", sqlite3_errmsg(db.db));
+    sqlite3_reset(erase);
+    return;
+  }
+
+  if (block.error)
+    abort_program("Compress database buffer failed!\n");
+
+  if (!insert)
+  {
+    const char* SQL = "INSERT INTO geometry (object_id, timestep, rank, idx, type, data_type, size, count, width, minimum, maximum, dim_factor, units, minX, minY, minZ, maxX, maxY, maxZ, labels, data) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
+    /* Prepare statement... */
+    if (sqlite3_prepare_v2(db.db, SQL, -1, &insert, NULL) != SQLITE_OK)
+      abort_program("SQL prepare error: (%s) %s\n", SQL, sqlite3_errmsg(db.db));
+  }
+
+  /* Bind all fields */
+  int c = 1;
+  sqlite3_bind_int(insert, c++, block.objid);
+  sqlite3_bind_int(insert, c++, block.step);
+  sqlite3_bind_int(insert, c++, block.height);
+  sqlite3_bind_int(insert, c++, block.depth);
+  sqlite3_bind_int(insert, c++, block.type);
+  sqlite3_bind_int(insert, c++, block.dtype);
+  sqlite3_bind_int(insert, c++, block.unitsize);
+  sqlite3_bind_int(insert, c++, block.count);
+  sqlite3_bind_int(insert, c++, block.width);
+  sqlite3_bind_double(insert, c++, block.minimum);
+  sqlite3_bind_double(insert, c++, block.maximum);
+  //Codec, with keyframe step offset and row ordinal if temporal
+  sqlite3_int64 codec = block.codec;
+  if (block.codec & GEOM_CODEC_TEMPORAL)
+  {
+    auto it = written.find(block.reference);
+    if (it == written.end())
+      abort_program("Keyframe data not written\n");
+    sqlite3_int64 offset = block.step - it->second.first;
+    codec |= (offset << GEOM_CODEC_BITS) | ((sqlite3_int64)it->second.second << (GEOM_CODEC_BITS + GEOM_KEYFRAME_BITS));
+    temporal = 1;
+  }
+  sqlite3_bind_int64(insert, c++, codec);
+  sqlite3_bind_text(insert, c++, block.label.c_str(), block.label.length(), SQLITE_STATIC);
+  for (int i=0; i<3; i++)
+    sqlite3_bind_double(insert, c++, block.min[i]);
+  for (int i=0; i<3; i++)
+    sqlite3_bind_double(insert, c++, block.max[i]);
+
+  /* Setup text data for insert (on vertex block only) */
+  if (block.labels.length() > 0)
+    sqlite3_bind_text(insert, c++, block.labels.c_str(), block.labels.length(), SQLITE_STATIC);
+  else
+    sqlite3_bind_null(insert, c++);
 
   /* Setup blob data for insert */
-  debug_print("Writing %lu bytes\n", src_len);
-  if (sqlite3_bind_blob(statement, 2, buffer, src_len, SQLITE_STATIC) != SQLITE_OK)
-    abort_program("SQL bind error: %s\n", sqlite3_errmsg(outdb.db));
+  const unsigned char* buffer = block.compressed.size() ? block.compressed.data() : block.src;
+  unsigned long len = block.compressed.size() ? block.compressed.size() : block.src_len;
+  debug_print("Writing %lu bytes\n", len);
+  if (sqlite3_bind_blob(insert, c++, buffer, len, SQLITE_STATIC) != SQLITE_OK)
+    abort_program("SQL bind error: %s\n", sqlite3_errmsg(db.db));
 
   /* Execute statement */
-  if (sqlite3_step(statement) != SQLITE_DONE )
-    abort_program("SQL step error: (%s) %s\n", SQL, sqlite3_errmsg(outdb.db));
+  if (sqlite3_step(insert) != SQLITE_DONE )
+    abort_program("SQL step error: (insert) %s\n", sqlite3_errmsg(db.db));
 
-  sqlite3_finalize(statement);
+  sqlite3_reset(insert);
+  sqlite3_clear_bindings(insert);
+
+  //Save step and ordinal of keyframe data (rows of each object/type/data type at a step are read back in order)
+  if (keyframes > 1)
+  {
+    std::string key = std::to_string(block.objid) + "/" + std::to_string(block.step) + "/" + std::to_string(block.type) + "/" + std::to_string(block.dtype);
+    unsigned int ordinal = ordinals[key]++;
+    if (!block.reference && ordinal < GEOM_ORDINAL_MAX)
+      written[block.src] = std::make_pair(block.step, ordinal);
+  }
 
   // Free compression buffer
-  if (cmp_len > 0) free(buffer);
+  std::vector<unsigned char>().swap(block.compressed);
+}
 
-  //printf("WROTE ID %d STEP %d TYPE %d DTYPE %d DIMS (%d x %d x %d) COUNT %d LABELS %s\n", 
-  //       objid, step, type, dtype, data->width, data->height, data->depth, block->size(), labels.c_str());
+void GeometryWriter::restore(const GeometryBlock& block)
+{
+  //Re-encode temporal rows at the following steps that use this object/type/step as keyframe,
+  //they are contiguous steps up to the next keyframe
+  KeyframeCache keyframes;
+  for (int step = block.step+1; step - block.step < (1 << GEOM_KEYFRAME_BITS); step++)
+  {
+    sqlite3_stmt* statement = db.select("SELECT id,dim_factor FROM geometry WHERE timestep=%d AND object_id=%d AND type=%d", step, block.objid, block.type);
+    if (!statement) return;
+    std::vector<sqlite3_int64> dependent;
+    bool found = false, next = false;
+    while (sqlite3_step(statement) == SQLITE_ROW)
+    {
+      found = true;
+      sqlite3_int64 codec = sqlite3_column_int64(statement, 1);
+      if (!(codec & GEOM_CODEC_TEMPORAL)) continue;
+      int offset = (codec >> GEOM_CODEC_BITS) & ((1 << GEOM_KEYFRAME_BITS) - 1);
+      if (step - offset == block.step)
+        dependent.push_back(sqlite3_column_int64(statement, 0));
+      else
+        next = true; //Rows relative to a later keyframe
+    }
+    sqlite3_finalize(statement);
+    if (!found || (next && !dependent.size())) return;
+
+    for (auto id : dependent)
+    {
+      statement = db.select("SELECT size,count,data_type,dim_factor,data FROM geometry WHERE id=%lld", (long long)id);
+      if (!statement) continue;
+      if (sqlite3_step(statement) == SQLITE_ROW)
+      {
+        GeometryRecord record;
+        record.object_id = block.objid;
+        record.timestep = step;
+        record.type = block.type;
+        record.size = sqlite3_column_int(statement, 0);
+        record.count = sqlite3_column_int(statement, 1);
+        record.data_type = (lucGeometryDataType)sqlite3_column_int(statement, 2);
+        sqlite3_int64 codec = sqlite3_column_int64(statement, 3);
+        record.codec = codec & ((1 << GEOM_CODEC_BITS) - 1);
+        const unsigned char* data = (const unsigned char*)sqlite3_column_blob(statement, 4);
+        record.blob.assign(data, data + sqlite3_column_bytes(statement, 4));
+        record.keyframe = Model::readKeyframe(db.db, NULL, record, codec, &keyframes);
+        record.inflate();
+        if (record.error)
+          abort_program("uncompress() failed! error code %d\n", record.error);
+
+        //Store in full
+        GeometryBlock full;
+        full.dtype = record.data_type;
+        full.unitsize = record.size;
+        full.count = record.count;
+        full.src = (const unsigned char*)record.data();
+        full.src_len = record.bytes();
+        full.compress(compression, filter, 0);
+        if (full.error)
+          abort_program("Compress database buffer failed!\n");
+        sqlite3_stmt* update;
+        if (sqlite3_prepare_v2(db.db, "UPDATE geometry SET dim_factor=?, data=? WHERE id=?", -1, &update, NULL) != SQLITE_OK)
+          abort_program("SQL prepare error: %s\n", sqlite3_errmsg(db.db));
+        sqlite3_bind_int(update, 1, full.codec);
+        if (full.compressed.size())
+          sqlite3_bind_blob(update, 2, full.compressed.data(), full.compressed.size(), SQLITE_STATIC);
+        else
+          sqlite3_bind_blob(update, 2, full.src, full.src_len, SQLITE_STATIC);
+        sqlite3_bind_int64(update, 3, id);
+        if (sqlite3_step(update) != SQLITE_DONE)
+          abort_program("SQL step error: (update) %s\n", sqlite3_errmsg(db.db));
+        sqlite3_finalize(update);
+      }
+      sqlite3_finalize(statement);
+    }
+  }
 }
 
 void Model::deleteObjectRecord(unsigned int id)
@@ -2442,6 +3438,7 @@ int Model::jsonRead(std::string data)
       imported.erase(del);
   //Load custom globals, merge with existing values
   Properties::mergeJSON(session.globals, imported);
+  session.stamp++;
 
   // Import colourmaps
   for (unsigned int i=0; i < cmaps.size(); i++)
@@ -48,13 +48,93 @@
 
 #define SQL_QUERY_MAX 4096
 
+//Geometry blob pre-compression filters, stored in the dim_factor field as version | filter flags
+//(version 0 = plain deflate, as written by older releases)
+//Temporal records also store where their keyframe row is above the codec bits: the step offset back to the
+//keyframe step, then the ordinal of the row among rows of the same object, type and data type at that step
+#define GEOM_CODEC_BITS    16
+#define GEOM_KEYFRAME_BITS 16
+#define GEOM_ORDINAL_MAX   (1 << 21)
+#define GEOM_CODEC_VERSION 0x100
+#define GEOM_CODEC_SHUFFLE 0x1 //Bytes of each element grouped by significance
+#define GEOM_CODEC_DELTA   0x2 //Elements stored as difference from previous element of same component
+#define GEOM_CODEC_QUANT8  0x4 //Floats stored as 8 bit integers within range of each component
+#define GEOM_CODEC_QUANT16 0x8 //Floats stored as 16 bit integers within range of each component
+#define GEOM_CODEC_TEMPORAL 0x10 //Data stored XOR the same block at a keyframe step
+#define GEOM_CODEC_ALL     (GEOM_CODEC_SHUFFLE | GEOM_CODEC_DELTA | GEOM_CODEC_QUANT8 | GEOM_CODEC_QUANT16 | GEOM_CODEC_TEMPORAL)
+
+void geometryEncode(unsigned char* data, unsigned int bytes, unsigned int elsize, unsigned int stride, int codec);
+void geometryDecode(unsigned char* data, unsigned int bytes, unsigned int elsize, unsigned int stride, int codec);
+unsigned int geometryQuantizeBits(lucGeometryDataType type, int quantize);
+void geometryQuantize(const float* values, unsigned int count, unsigned int stride, unsigned int bytes, std::vector<unsigned char>& out);
+void geometryDequantize(const unsigned char* data, unsigned int count, unsigned int stride, unsigned int bytes, float* out);
+
+//Geometry table row, read from database and decompressed before loading into renderers
+class GeometryRecord
+{
+public:
+  int object_id = 0;
+  DrawingObject* obj = NULL;
+  int timestep = 0;
+  int height = 0;
+  int depth = 0;
+  int width = 0;
+  int count = 0;
+  int size = 1;
+  int items = 0;
+  int codec = 0;
+  lucGeometryType type = lucMinType;
+  lucGeometryDataType data_type = lucMinDataType;
+  float minimum = 0;
+  float maximum = 0;
+  bool bounds = false;
+  float min[3] = {0,0,0};
+  float max[3] = {0,0,0};
+  std::string data_label;
+  std::string labels;
+  std::vector<unsigned char> blob;   //Row data as stored, possibly compressed
+  std::vector<unsigned char> buffer; //Decompressed row data
+  int error = 0;                     //Decompression result if failed
+  sqlite3_int64 rowid = 0;           //Large rows: not read, streamed from database when loaded
+  unsigned int stream = 0;           //Large rows: stored size
+  std::string source;                //Large rows: attached database prefix
+  std::shared_ptr<GeometryRecord> keyframe; //Temporal rows: row the data is stored relative to
+
+  bool compressed() {return blob.size() != (size_t)count * GeomData::byteSize(data_type);}
+  const void* data() {return stream ? NULL : compressed() ? buffer.data() : blob.data();}
+  unsigned int bytes() {return stream ? stream : compressed() ? buffer.size() : blob.size();}
+  void inflate();
+};
+
+//Keyframe rows read in one pass, by query
+typedef std::map<std::string, std::shared_ptr<GeometryRecord> > KeyframeCache;
+
+//Timestep database file attached to a Database, with its cached statements
+class Attachment
+{
+public:
+  int step;
+  std::string path;
+  unsigned int used;
+  std::map<std::string, sqlite3_stmt*> statements;
+
+  Attachment(int step, const std::string& path) : step(step), path(path), used(0) {}
+};
+
 class Database
 {
   friend class Model; //Allow private access from Model
+  friend class GeometryWriter;
 private:
   bool readonly;
   bool silent;
   char SQL[SQL_QUERY_MAX];
+  std::vector<Attachment> pool; //Attached timestep databases, least recently used detached when full
+  unsigned int accesses = 0;
+
+  Attachment* findAttached(int step);
+  bool detach(unsigned int idx);
+  void clearAttached();
 
 protected:
   TimeStep* attached;
@@ -74,16 +154,95 @@ public:
   void attach(TimeStep* timestep);
 
   sqlite3_stmt* select(const char* fmt, ...);
+  sqlite3_stmt* prepare(const char* fmt, ...);
+  void release(sqlite3_stmt* statement);
   bool issue(const char* fmt, ...);
 
   operator bool() const { return db != NULL; }
 };
 
+//Geometry table block to write, compressed by worker threads before insert
+class GeometryBlock
+{
+public:
+  bool erase = false;  //Delete existing data of this object/type/step instead of insert
+  unsigned int objid = 0;
+  int step = 0;
+  int height = 0;
+  int depth = 0;
+  int width = 0;
+  lucGeometryType type = lucMinType;
+  lucGeometryDataType dtype = lucMinDataType;
+  unsigned int unitsize = 0;
+  unsigned int count = 0;
+  float minimum = 0;
+  float maximum = 0;
+  float min[3] = {0,0,0};
+  float max[3] = {0,0,0};
+  std::string label;
+  std::string labels;
+  const unsigned char* src = NULL;    //Source data, must remain valid until written
+  unsigned long src_len = 0;
+  const unsigned char* reference = NULL; //Keyframe data of same size, already written, to store difference from
+  std::vector<unsigned char> compressed;
+  int codec = 0;
+  int error = 0;
+
+  void compress(int level, int filter, int quantize);
+};
+
+//Bulk geometry writer, inserts blocks with a single prepared statement
+//while the following blocks are compressed by worker threads
+class GeometryWriter
+{
+  Database& db;
+  int compression;
+  int filter;
+  int quantize;
+  int threads;
+  sqlite3_stmt* insert = NULL;
+  sqlite3_stmt* erase = NULL;
+  std::vector<GeometryBlock> queued;
+  std::vector<GeometryBlock> compressing;
+  size_t queuedbytes = 0;
+  std::thread compressor;
+  std::map<const unsigned char*, std::pair<int, unsigned int> > written; //Step and ordinal of keyframe data
+  std::map<std::string, unsigned int> ordinals; //Rows written per object, step, type and data type
+  int temporal = -1; //Database has temporal rows (-1 = not yet checked)
+
+  void next();
+  void store(GeometryBlock& block);
+  void restore(const GeometryBlock& block);
+
+public:
+  int keyframes = 0; //Temporal encoding, steps between keyframes (0 = disabled)
+
+  GeometryWriter(Database& db, int compression, int filter=0, int quantize=0, int threads=0);
+  ~GeometryWriter();
+
+  void write(GeometryBlock& block);
+  void flush();
+};
+
 class Model
 {
 private:
   int now;            //Loaded step per model
   Session& session;
+  unsigned int accesses = 0; //Timestep access counter
+
+  //Background prefetch of upcoming timesteps
+  std::thread prefetch_thread;
+  std::mutex prefetch_mutex;
+  std::condition_variable prefetch_cv; //Signalled on new requests and when a step is loaded
+  std::atomic<bool> prefetch_cancel; //Abandon the step being read
+  bool prefetch_quit = false;
+  int prefetch_loading = -1;         //Step being read by the prefetch thread
+  int prefetch_threads = 1;
+  std::string prefetch_db;           //Main database path
+  std::vector<int> prefetch_steps;   //Steps queued for the prefetch thread
+  std::vector<std::string> prefetch_paths; //Database file of each queued step
+  std::map<int, std::vector<GeometryRecord> > prefetched; //Loaded records by step
 
 public:
 
@@ -154,6 +313,7 @@ public:
   View* defaultView(Properties* properties=NULL);
 
   void cacheLoad();
+  void cacheEvict();
 
 public:
   int step()
@@ -180,7 +340,16 @@ public:
   int setTimeStep(int stepidx);
   int loadGeometry(int obj_id=0, int time_start=-1, int time_stop=-1);
   int loadFixedGeometry(int obj_id=0);
+  static std::string geometryData(const char* prefix, bool stream);
+  static sqlite3_stmt* selectGeometry(Database& db, const char* filter, bool stream=true);
   int readGeometryRecords(sqlite3_stmt* statement, bool cache=true);
+  static bool readGeometryRecord(sqlite3_stmt* statement, GeometryRecord& record, KeyframeCache* keyframes=NULL);
+  static std::shared_ptr<GeometryRecord> readKeyframe(sqlite3* db, const char* source, GeometryRecord& record, sqlite3_int64 codec, KeyframeCache* keyframes=NULL);
+  void loadGeometryRecord(GeometryRecord& record, bool cache=true);
+  void streamGeometryRecord(GeometryRecord& record, DataContainer* container, unsigned int items);
+  void prefetch(int stepidx);
+  int loadPrefetched(int step);
+  void clearPrefetch();
   void mergeDatabases();
   void mergeRecords(Model* other);
   void updateObject(DrawingObject* target, lucGeometryType type);
@@ -188,10 +357,10 @@ public:
   void writeDatabase(Database& outdb, DrawingObject* obj=NULL);
   void writeState();
   void writeState(Database& outdb);
-  void writeObjects(Database& outdb, DrawingObject* obj=NULL, int step=-1);
-  void deleteGeometry(Database& outdb, lucGeometryType type, DrawingObject* obj, int step);
-  void writeGeometry(Database& outdb, Geometry* g, DrawingObject* obj, int step);
-  void writeGeometryRecord(Database& outdb, lucGeometryType type, lucGeometryDataType dtype, unsigned int objid, Geom_Ptr data, DataContainer* block, int step);
+  void writeObjects(GeometryWriter& writer, DrawingObject* obj=NULL, int step=-1);
+  void deleteGeometry(GeometryWriter& writer, lucGeometryType type, DrawingObject* obj, int step);
+  void writeGeometry(GeometryWriter& writer, Geometry* g, DrawingObject* obj, int step);
+  void writeGeometryRecord(GeometryWriter& writer, lucGeometryType type, lucGeometryDataType dtype, unsigned int objid, Geom_Ptr data, DataContainer* block, int step, DataContainer* reference=NULL);
   void deleteObjectRecord(unsigned int id);
   void backup(Database& fromdb, Database& todb);
   void calculateBounds(View* aview, float* default_min=NULL, float* default_max=NULL);
@@ -120,16 +120,18 @@ void Points::loadVertices()
     if (colrange < 1) colrange = 1;
     debug_print("Using 1 colour per %d vertices (%d : %d)\n", colrange, geom[s]->count(), hasColours);
 
-    Properties& props = geom[s]->draw->properties;
-    float psize0 = props["pointsize"];
-    float scaling = props["scaling"];
+    const RenderProperties& props = geom[s]->draw->compiled();
+    float psize0 = props.pointsize;
+    float scaling = props.scaling;
     //printf("psize %f * scaling %f = %f\n", psize0, scaling, psize0 * scaling);
     psize0 *= scaling;
     float ptype = getPointType(s); //Default (-1) is to use the global (uniform) value
     unsigned int sizeidx = geom[s]->valuesLookup(geom[s]->draw->properties["sizeby"]);
     bool usesize = geom[s]->valueData(sizeidx) != NULL;
     //std::cout << geom[s]->draw->properties["sizeby"] << " : " << sizeidx << " : " << usesize << std::endl;
-    Colour colour;
+    //Lookup all the colours required in one pass
+    std::vector<Colour> colours(geom[s]->count() ? (geom[s]->count()-1) / colrange + 1 : 0);
+    getColour.colourise(colours.data(), 0, colours.size());
     bool hasTexture = geom[s]->hasTexture();
     bool hasTexCoords = geom[s]->render->texCoords.size()/2 == geom[s]->count();
     float nullTexCoord[2] = {0.0, -1.0};
@@ -142,12 +144,8 @@ void Points::loadVertices()
         //Copies vertex bytes
         memcpy(ptr, geom[s]->render->vertices[i], sizeof(float) * 3);
         ptr += sizeof(float) * 3;
-        //getColour(c, i);
         //Have colour values but not enough for per-vertex, spread over range (eg: per triangle)
-        unsigned int cidx = i / colrange;
-        if (cidx * colrange == i)
-          getColour(colour, cidx);
-        memcpy(ptr, &colour, sizeof(Colour));
+        memcpy(ptr, &colours[i / colrange], sizeof(Colour));
         ptr += sizeof(Colour);
         //Optional texcoord
         if (anyHasTexture)
@@ -212,6 +210,8 @@ void Points::loadList()
 
   //Create sorting array
   sorter.allocate(total);
+  sorter.threads = session.global("threads");
+  sorter.generation = &session.sortGeneration;
 
   if (geom.size() == 0) return;
   int voffset = 0;
@@ -236,7 +236,8 @@ void Points::loadList()
     geom[s]->colourCalibrate();
 
     //Override opaque if pointtype requires opacity (1/2) unless explicitly set
-    if (geom[s]->opaqueCheck() && (int)geom[s]->draw->properties["pointtype"] < 2 && !geom[s]->draw->properties["opaque"])
+    const RenderProperties& props = geom[s]->draw->compiled();
+    if (geom[s]->opaqueCheck() && props.pointtype < 2 && !props.opaque)
       geom[s]->opaque = false;
 
     bool filter = geom[s]->draw->filterCache.size();
@@ -249,15 +250,16 @@ void Points::loadList()
       if (subSample > 1 && SHR3(SEED) % subSample > 0) continue;
 
       sorter.buffer[elements].index = sorter.indices[elements] = voffset + i;
-      sorter.buffer[elements].vertex = geom[s]->render->vertices[i];
       sorter.buffer[elements].distance = 0;
 
       if (geom[s]->opaque)
       {
         //All opaque points at start
         sorter.buffer[elements].distance = USHRT_MAX;
-        sorter.buffer[elements].vertex = NULL;
+        sorter.opaque++;
       }
+      else
+        sorter.positions[elements] = Vec3d(geom[s]->render->vertices[i]);
 
       elements++;
       counts[s] ++; //Element count
@@ -284,36 +286,24 @@ void Points::sort()
   t1 = clock();
 
   //Calculate min/max distances from view plane
+  sorter.stamp = session.sortGeneration;
   float distanceRange[2];
   view->getMinMaxDistance(min, max, distanceRange, true);
 
   //Update eye distances, clamping distance to integer between 0 and USHRT_MAX-1
-  //float multiplier = (float)USHRT_MAX / (distanceRange[1] - distanceRange[0]);
-  float multiplier = (USHRT_MAX-1.0) / (distanceRange[1] - distanceRange[0]);
-  float fdistance;
-  unsigned int opaqueCount = 0;
-  for (unsigned int i = 0; i < elements; i++)
+  //Distance from viewing plane is -eyeZ, max dist 65535 reserved for opaque points
+  if (sorter.opaque < elements && !view->eyePlaneKeys(sorter.positions.data(), elements, distanceRange, sorter.distances.data(), sorter.threads, sorter.generation, sorter.stamp))
   {
-    //Max dist 65535 reserved for opaque triangles
-    if (sorter.buffer[i].distance < USHRT_MAX)
-    {
-      //Distance from viewing plane is -eyeZ
-      fdistance = view->eyePlaneDistance(sorter.buffer[i].vertex);
-      //fdistance = view->eyeDistance(sorter.buffer[i].vertex);
-      //float d = floor(multiplier * (fdistance - distanceRange[0])) + 0.5;
-      //assert(d < USHRT_MAX);
-      //assert(d >= 0);
-      sorter.buffer[i].distance = (unsigned short)(multiplier * (fdistance - distanceRange[0]));
-    }
-    else
-      opaqueCount++;
+    debug_print("  sort cancelled, view changed\n");
+    return;
   }
+  sorter.opaqueKeys(elements);
   t2 = clock();
   debug_print("  %.4lf seconds to calculate distances\n", (t2-t1)/(double)CLOCKS_PER_SEC);
   t1 = clock();
 
   //Skip sort if all opaque
-  if (opaqueCount == elements)
+  if (sorter.opaque == elements)
   {
     debug_print("No sort necessary\n");
     return;
@@ -322,15 +312,19 @@ void Points::sort()
   //Depth sort using 2-byte key radix sort, 10 times faster than equivalent quicksort
   if (view->is3d)
   {
-    sorter.sort(elements);
+    if (!sorter.sort(elements))
+    {
+      debug_print("  sort cancelled, view changed\n");
+      return;
+    }
     t2 = clock();
-    debug_print("  %.4lf seconds to sort %d points\n", (t2-t1)/(double)CLOCKS_PER_SEC, elements);
+    debug_print("  %.4lf seconds to sort %d points%s\n", (t2-t1)/(double)CLOCKS_PER_SEC, elements, sorter.incremental ? " (incremental)" : "");
   }
 
   //Re-map vertex indices in sorted order
   t1 = clock();
-  //Lock the update mutex, to allow updating the indexlist and prevent access while drawing
-  LOCK_GUARD(loadmutex);
+  //Write the new index list aside, drawing continues with the old one until swapped in
+  std::vector<unsigned int>& indices = sorter.output();
   //Reverse order farthest to nearest
   //int distSample = session.global("pointdistsample");
   //uint32_t SEED;
@@ -344,7 +338,7 @@ void Points::sort()
       int subSample = 1 + distSample * sorter.buffer[i].distance / (USHRT_MAX-1.0); //[1,distSample]
       if (subSample > 1 && SHR3(SEED) % subSample > 0) continue;
     }*/
-    sorter.indices[idxcount] = sorter.buffer[i].index;
+    indices[idxcount] = sorter.sorted(i).index;
     idxcount ++;
   }
 
@@ -355,8 +349,8 @@ void Points::sort()
     debug_print("  %.4lf seconds to load %d indices)\n", (t2-t1)/(double)CLOCKS_PER_SEC, idxcount);
   t1 = clock();
 
-  //Force update after sort
-  sorter.changed = true;
+  //Swap in, forces update after sort
+  sorter.publish(loadmutex);
 }
 
 //Reloads points into display list or VBO, required after data update and depth sort
@@ -398,8 +392,9 @@ int Points::getPointType(int index)
 {
   if (index != -1)
   {
-    if (geom[index]->draw->properties.has("pointtype"))
-      return geom[index]->draw->properties["pointtype"];
+    const RenderProperties& props = geom[index]->draw->compiled();
+    if (props.haspointtype)
+      return props.pointtype;
     else
       return -1; //Use global 
   }
@@ -438,7 +433,7 @@ void Points::draw()
 
 
   //Point size distance attenuation (disabled for 2d models)
-  float scale0 = (float)geom[0]->draw->properties["scalepoints"];
+  float scale0 = geom[0]->draw->compiled().scalepoints;
   int pointspixels = session.global("pointpixelscale");
   if (pointspixels == 1)
     pointspixels = view->base_height; //Saved height at first render
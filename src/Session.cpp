@@ -83,6 +83,7 @@ int Session::parse(Properties* target, const std::string& property)
 
   //If Properties object provided, parse into its data, otherwise into globals
   json& dest = target ? target->data : globals;
+  stamp++;
 
   std::string key, value;
   size_t pos = property.find("=");
@@ -225,6 +226,7 @@ void Session::parseSet(Properties& target, const std::string& properties)
   {
     json props = json::parse(properties);
     target.merge(props);
+    stamp++;
   }
   //Otherwise, provided as single prop=value per line
   //where value is a parsable as json
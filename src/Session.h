@@ -67,6 +67,10 @@ public:
 
   //Property metadata / documentation
   json_fifo properties;
+  //Incremented when properties may have changed, invalidates compiled object properties
+  unsigned int stamp = 1;
+  //Incremented on each depth sort request, sorts still running for an older view give up
+  std::atomic<unsigned int> sortGeneration{0};
 
   // Engines - mersenne twister
   std::mt19937 eng0, eng1;
@@ -72,7 +72,10 @@ void Shapes::update()
       //Lower default sphere quality
       //quality = props.getInt("segments", 16);
       if ((int)props["pointtype"] > 2 && !props.has("specular"))
+      {
         props.data["specular"] = 1.0;
+        geom[i]->draw->compile();
+      }
       //Plot cuboids?
       if (dynamic_cast<Cuboids*>(this))
         shape = 1;
@@ -86,6 +89,7 @@ void Shapes::update()
     props.data["vertexnormals"] = (shape != 1);
 
     if (scaling <= 0) scaling = 1.0;
+    scaling *= geom[i]->draw->compiled().scaleshapes;
 
     Colour colour;
     ColourLookup& getColour = geom[i]->colourCalibrate();
@@ -99,10 +103,16 @@ void Shapes::update()
     unsigned int idxL = geom[i]->valuesLookup(geom[i]->draw->properties["lengthby"]);
 
     bool hasTexture = geom[i]->hasTexture();
-    bool filter = geom[i]->draw->filterCache.size();
-    for (unsigned int v=0; v < geom[i]->count(); v++)
+    //Rotation property, used for all shapes without an alignment vector
+    bool hasRotation = props.has("rotation");
+    Quaternion proprot;
+    if (hasRotation)
+      proprot = rotationFromProperty(props["rotation"]);
+
+    //Iterate only the vertices not filtered out
+    for (unsigned int v=geom[i]->unfiltered(0); v < geom[i]->count(); v=geom[i]->unfiltered(v+1))
     {
-      if (!drawable(i) || (filter && geom[i]->filter(v))) continue;
+      if (!drawable(i)) break;
       //Scale the dimensions by variables (dynamic range options? by setting max/min?)
       Vec3d sdims = Vec3d(dims[0], dims[1], dims[2]);
       if (geom[i]->valueData(idxW)) sdims[0] = geom[i]->valueData(idxW, v);
@@ -116,7 +126,7 @@ void Shapes::update()
       {
         if (dims[c] != FLT_MIN) sdims[c] *= dims[c];
         //Apply scaling
-        sdims[c] *= scaling * (float)props["scaleshapes"];
+        sdims[c] *= scaling;
       }
 
       //Scale position & vector manually (global scaling is disabled to avoid distorting glyphs)
@@ -133,13 +143,8 @@ void Shapes::update()
       //Otherwise use the rotation property
       else
       {
-        //std::cout << props.data << std::endl;
-        if (props.has("rotation"))
-        {
-          json jrot = props["rotation"];
-          //std::cout << "JROT: " << jrot << std::endl;
-          rot = rotationFromProperty(jrot);
-        }
+        if (hasRotation)
+          rot = proprot;
         //Default rotation for spheres for texturing
         else if (shape == 0 && hasTexture)
         {
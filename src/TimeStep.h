@@ -46,6 +46,9 @@ public:
   //Timestep properties data...
   Properties properties;
   bool loaded = false;
+  unsigned int used = 0; //Access order, for cache eviction
+  unsigned int records = 0; //Geometry rows in the model database
+  size_t bytes = 0;         //Stored size of geometry data for this step
 
   TimeStep(json& globals, json& defaults, int step, const std::string& path="") : step(step), path(path), properties(globals, defaults) {}
   TimeStep(json& globals, json& defaults) : step(0), properties(globals, defaults) {}
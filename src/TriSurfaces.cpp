@@ -38,6 +38,115 @@
 //Triangle centroid for depth sorting
 #define centroid(v1,v2,v3) {centroids.emplace_back((v1[0]+v2[0]+v3[0])/3, (v1[1]+v2[1]+v3[1])/3, (v1[2]+v2[2]+v3[2])/3);}
 
+//Hash of integer grid cell coords into a power of two bucket count
+static inline unsigned int cellHash(long long x, long long y, long long z, size_t mask)
+{
+  return (unsigned int)(((size_t)(x * 73856093LL) ^ (size_t)(y * 19349663LL) ^ (size_t)(z * 83492791LL)) & mask);
+}
+
+//Vertex copy stored in hash buckets, keeps each bucket contiguous in memory
+struct HashedVertex
+{
+  float pos[3];
+  unsigned int id;
+
+  bool operator==(const HashedVertex &rhs) const
+  {
+    //Same comparison as Vertex, uses Vertex::VERT_EPSILON to decide equality
+    return fabs(pos[0] - rhs.pos[0]) < Vertex::VERT_EPSILON && fabs(pos[1] - rhs.pos[1]) < Vertex::VERT_EPSILON && fabs(pos[2] - rhs.pos[2]) < Vertex::VERT_EPSILON;
+  }
+};
+
+//Find an earlier vertex within Vertex::VERT_EPSILON of each vertex
+//Uses a spatial hash of cells 8 x VERT_EPSILON wide, so any match is in the same cell
+//unless the vertex is within VERT_EPSILON of a cell boundary, then adjacent cells are checked
+//(verts must be in id order, first[v] == v when there is no earlier match)
+static void matchVertices(std::vector<Vertex>& verts, std::vector<unsigned int>& first, int threads)
+{
+  size_t N = verts.size();
+  double inv = Vertex::VERT_EPSILON > 0.0 ? 0.125 / Vertex::VERT_EPSILON : 1.0;
+  size_t buckets = 1;
+  while (buckets < N) buckets <<= 1;
+  size_t mask = buckets - 1;
+
+  std::vector<unsigned int> hash(N);
+  parallelRange(N, threads, [&](size_t start, size_t end, unsigned int t)
+  {
+    for (size_t v=start; v<end; v++)
+    {
+      float* p = verts[v].vert;
+      hash[v] = cellHash((long long)floor(p[0] * inv), (long long)floor(p[1] * inv), (long long)floor(p[2] * inv), mask);
+    }
+  }, 65536);
+
+  //Bucket vertices by cell hash, ids remain ascending within each bucket
+  std::vector<unsigned int> offsets(buckets+1, 0);
+  std::vector<HashedVertex> items(N);
+  for (size_t v=0; v<N; v++)
+    offsets[hash[v]+1]++;
+  for (size_t b=0; b<buckets; b++)
+    offsets[b+1] += offsets[b];
+  for (size_t v=0; v<N; v++)
+  {
+    HashedVertex& h = items[offsets[hash[v]]++];
+    memcpy(h.pos, verts[v].vert, sizeof(float) * 3);
+    h.id = v;
+  }
+  for (size_t b=buckets; b>0; b--)
+    offsets[b] = offsets[b-1];
+  offsets[0] = 0;
+
+  //Search bucket by bucket, most duplicates are exact copies found in the same bucket
+  first.resize(N);
+  parallelRange(buckets, threads, [&](size_t start, size_t end, unsigned int t)
+  {
+    for (size_t b=start; b<end; b++)
+    {
+      for (unsigned int i=offsets[b]; i<offsets[b+1]; i++)
+      {
+        HashedVertex& h = items[i];
+        unsigned int match = h.id;
+        for (unsigned int j=offsets[b]; j<i; j++)
+        {
+          if (items[j] == h)
+          {
+            match = items[j].id;
+            break;
+          }
+        }
+
+        if (match == h.id)
+        {
+          //Check adjacent cells when close to the boundary
+          //(allow a margin over 1/8 of a cell for rounding)
+          long long c[3];
+          int side[3];
+          for (int k=0; k<3; k++)
+          {
+            double x = h.pos[k] * inv;
+            c[k] = (long long)floor(x);
+            side[k] = x - c[k] < 0.15 ? -1 : (x - c[k] > 0.85 ? 1 : 0);
+          }
+          for (int n=1; n<8 && match == h.id; n++)
+          {
+            if ((n&1 && !side[0]) || (n&2 && !side[1]) || (n&4 && !side[2])) continue;
+            unsigned int nb = cellHash(c[0] + (n&1 ? side[0] : 0), c[1] + (n&2 ? side[1] : 0), c[2] + (n&4 ? side[2] : 0), mask);
+            for (unsigned int j=offsets[nb]; j<offsets[nb+1] && items[j].id < h.id; j++)
+            {
+              if (items[j] == h)
+              {
+                match = items[j].id;
+                break;
+              }
+            }
+          }
+        }
+        first[h.id] = match;
+      }
+    }
+  }, 4096);
+}
+
 TriSurfaces::TriSurfaces(Session& session) : Triangles(session)
 {
   tricount = 0;
@@ -123,8 +232,7 @@ void TriSurfaces::loadMesh()
     }
 
     //Add vertices to a vector with indices
-    //Sort vertices vector with std::sort & custom compare sort( vec.begin(), vec.end() );
-    //Iterate, for duplicates replace indices with index of first
+    //Find duplicates with a spatial hash, replace indices with index of first
     //Remove duplicate vertices Triangles stored as list of indices
     unsigned int hasColours = geom[index]->hasTexture() ? 0 : geom[index]->colourCount();
     bool vertColour = hasColours && (hasColours == geom[index]->count());
@@ -171,7 +279,7 @@ void TriSurfaces::loadMesh()
 
       elements += triverts;
 
-      //Now have list of vertices sorted by vertex pos with summed normals and references of duplicates replaced
+      //Now have list of vertices in id order with summed normals and references of duplicates replaced
       t1 = clock();
 
       //If not optimising the vertices (usually to preserve texture)
@@ -293,6 +401,7 @@ void TriSurfaces::loadMesh()
 
     //Update the rendering references as some containers have been replaced
     geom[index]->setRenderData();
+    geom[index]->releaseStore(); //Free the replaced containers
 
     t2 = clock();
     debug_print("  %.4lf seconds to normalise (and re-buffer)\n", (t2-t1)/(double)CLOCKS_PER_SEC);
@@ -332,56 +441,49 @@ void TriSurfaces::smoothMesh(int index, std::vector<Vertex> &verts, std::vector<
   debug_print("  %.4lf seconds to calc facet normals\n", (t2-t1)/(double)CLOCKS_PER_SEC);
   t1 = clock();
 
-  //Sort by vertex
-  std::sort(verts.begin(), verts.end());
+  //Find duplicates with a spatial hash and replace references to normals
+  //Set vertex comparison epsilon to 1/100,000th of model dimensions
+  Vertex::VERT_EPSILON = view->model_size * 0.00001;
+  std::vector<unsigned int> first;
+  matchVertices(verts, first, session.global("threads"));
   t2 = clock();
-  debug_print("  %.4lf seconds to sort %d verts\n", (t2-t1)/(double)CLOCKS_PER_SEC, verts.size());
+  debug_print("  %.4lf seconds to hash %d verts\n", (t2-t1)/(double)CLOCKS_PER_SEC, verts.size());
   t1 = clock();
 
-  //Now have list of vertices sorted by vertex pos
-  //Search for duplicates and replace references to normals
-  int match = 0;
+  //Merge in id order, so the first occurrence of each vertex is always processed before its duplicates
   int dupcount = 0;
-  //Set vertex comparison epsilon to 1/100,000th of model dimensions
-  Vertex::VERT_EPSILON = view->model_size * 0.00001;
   for (unsigned int v=1; v<verts.size(); v++)
   {
-    //This uses Vertex::VERT_EPSILON to decide equality
-    if (verts[match] == verts[v])
+    if (first[v] == v) continue;
+    //Earlier match may itself be a duplicate, merge with the vertex it references
+    Vertex& match = verts[verts[first[v]].ref];
+    // If the angle between a given face normal and the face normal
+    // associated with the first triangle in the list of triangles for the
+    // current vertex is greater than a specified angle, normal is not added
+    // to average normal calculation and the corresponding vertex is given
+    // the facet normal. This preserves hard edges, specific angle to
+    // use depends on the model, but 90 degrees is usually a good start.
+
+    // cosine of angle between vectors = (v1 . v2) / |v1|.|v2|
+    float angle = vnormals ? RAD2DEG * normals[verts[v].id].angle(normals[match.id]) : 0;
+    //debug_print("angle %f ", angle);
+    //Don't include vertices in the sum if angle between normals too sharp
+    if (angle < anglemin)
     {
-      // If the angle between a given face normal and the face normal
-      // associated with the first triangle in the list of triangles for the
-      // current vertex is greater than a specified angle, normal is not added
-      // to average normal calculation and the corresponding vertex is given
-      // the facet normal. This preserves hard edges, specific angle to
-      // use depends on the model, but 90 degrees is usually a good start.
-
-      // cosine of angle between vectors = (v1 . v2) / |v1|.|v2|
-      float angle = vnormals ? RAD2DEG * normals[verts[v].id].angle(normals[verts[match].id]) : 0;
-      //debug_print("angle %f ", angle);
-      //Don't include vertices in the sum if angle between normals too sharp
-      if (angle < anglemin)
-      {
-        //Found a duplicate, replace reference idx (original retained in "id")
-        verts[v].ref = verts[match].ref;
-        dupcount++;
+      //Found a duplicate, replace reference idx (original retained in "id")
+      verts[v].ref = match.ref;
+      dupcount++;
 
-        //Add this normal to matched normal
-        if (vnormals)
-          normals[verts[match].id] += normals[verts[v].id];
+      //Add this normal to matched normal
+      if (vnormals)
+        normals[match.id] += normals[verts[v].id];
 
-        //Colour value, add to matched
-        if (optimise && vertColour && geom[index]->colourData())
-          geom[index]->colourData()->value[verts[match].id] += geom[index]->colourData()->value[verts[v].id];
+      //Colour value, add to matched
+      if (optimise && vertColour && geom[index]->colourData())
+        geom[index]->colourData()->value[match.id] += geom[index]->colourData()->value[verts[v].id];
 
-        verts[match].vcount++;
-        verts[v].vcount = 0;
-      }
-    }
-    else
-    {
-      //First occurrence, following comparisons will be against this vertex...
-      match = v;
+      match.vcount++;
+      verts[v].vcount = 0;
     }
   }
   t2 = clock();
@@ -440,6 +542,8 @@ void TriSurfaces::loadList()
 
   //Create sorting array
   sorter.allocate(total/3, 3);
+  sorter.threads = session.global("threads");
+  sorter.generation = &session.sortGeneration;
 
   //Element counts to actually plot (exclude filtered/hidden) per geom entry
   counts.clear();
@@ -487,13 +591,13 @@ void TriSurfaces::loadList()
       if (geom[index]->opaque)
       {
         sorter.buffer[tricount].distance = USHRT_MAX;
-        sorter.buffer[tricount].vertex = NULL;
+        sorter.opaque++;
       }
       else
       {
         //Triangle centroid for depth sorting
         assert(offset < centroids.size());
-        sorter.buffer[tricount].vertex = centroids[offset].ref();
+        sorter.positions[tricount] = centroids[offset];
       }
       tricount++;
       counts[index] += 3; //Element count
@@ -521,38 +625,24 @@ void TriSurfaces::sort()
   assert(sorter.buffer);
 
   //Calculate min/max distances from view plane
+  sorter.stamp = session.sortGeneration;
   float distanceRange[2];
   view->getMinMaxDistance(min, max, distanceRange, true);
 
-  //Update eye distances, clamping int distance to integer between 1 and 65534
-  float multiplier = (USHRT_MAX-1.0) / (distanceRange[1] - distanceRange[0]);
-  unsigned int opaqueCount = 0;
-  float fdistance;
-  for (unsigned int i = 0; i < tricount; i++)
+  //Update eye distances, clamping int distance to integer between 0 and 65534
+  //Distance from viewing plane is -eyeZ, max dist 65535 reserved for opaque triangles
+  if (sorter.opaque < tricount && !view->eyePlaneKeys(sorter.positions.data(), tricount, distanceRange, sorter.distances.data(), sorter.threads, sorter.generation, sorter.stamp))
   {
-    //Distance from viewing plane is -eyeZ
-    //Max dist 65535 reserved for opaque triangles
-    if (sorter.buffer[i].distance < USHRT_MAX)
-    {
-      assert(sorter.buffer[i].vertex);
-      fdistance = view->eyePlaneDistance(sorter.buffer[i].vertex);
-      //fdistance = view->eyeDistance(sorter.buffer[i].vertex);
-      fdistance = std::min(distanceRange[1], std::max(distanceRange[0], fdistance)); //Clamp to range
-      sorter.buffer[i].distance = (unsigned short)(multiplier * (fdistance - distanceRange[0]));
-      //if (i%10000==0) printf("%d : centroid %f %f %f distance %f %d\n", i, sorter.buffer[i].vertex[0], sorter.buffer[i].vertex[1], sorter.buffer[i].vertex[2], fdistance, sorter.buffer[i].distance);
-      //Reverse as radix sort is ascending and we want to draw by distance descending
-      //sorter.buffer[i].distance = USHRT_MAX - (unsigned short)(multiplier * (fdistance - mindist));
-      //assert(sorter.buffer[i].distance >= 1 && sorter.buffer[i].distance <= USHRT_MAX);
-    }
-    else
-      opaqueCount++;
+    debug_print("  sort cancelled, view changed\n");
+    return;
   }
+  sorter.opaqueKeys(tricount);
   t2 = clock();
   debug_print("  %.4lf seconds to calculate distances\n", (t2-t1)/(double)CLOCKS_PER_SEC);
   t1 = clock();
 
   //Skip sort if all opaque
-  if (opaqueCount == tricount) 
+  if (sorter.opaque == tricount)
   {
     debug_print("No sort necessary\n");
     return;
@@ -568,20 +658,24 @@ void TriSurfaces::sort()
   if (view->is3d)
   {
     //Depth sort using 2-byte key radix sort, 10 times faster than equivalent quicksort
-    sorter.sort(tricount);
+    if (!sorter.sort(tricount))
+    {
+      debug_print("  sort cancelled, view changed\n");
+      return;
+    }
     t2 = clock();
-    debug_print("  %.4lf seconds to sort %d triangles\n", (t2-t1)/(double)CLOCKS_PER_SEC, tricount);
+    debug_print("  %.4lf seconds to sort %d triangles%s\n", (t2-t1)/(double)CLOCKS_PER_SEC, tricount, sorter.incremental ? " (incremental)" : "");
   }
 
-  //Lock the update mutex, to allow updating the indexlist and prevent access while drawing
+  //Write the new index list aside, drawing continues with the old one until swapped in
   t1 = clock();
-  LOCK_GUARD(loadmutex);
+  std::vector<unsigned int>& indices = sorter.output();
   unsigned int idxcount = 0;
   for(int i=tricount-1; i>=0; i--)
   {
     assert(idxcount < 3 * tricount * sizeof(unsigned int));
     //Copy index bytes
-    memcpy(&sorter.indices[idxcount], sorter.buffer[i].index, sizeof(GLuint) * 3);
+    memcpy(&indices[idxcount], sorter.sorted(i).index, sizeof(GLuint) * 3);
     idxcount += 3;
     //if (i%100==0) printf("%d ==> %d,%d,%d\n", i, sorter.buffer[i].index[0], sorter.buffer[i].index[1], sorter.buffer[i].index[2]);
   }
@@ -589,8 +683,8 @@ void TriSurfaces::sort()
   t2 = clock();
   debug_print("  %.4lf seconds to save %d triangle indices\n", (t2-t1)/(double)CLOCKS_PER_SEC, tricount*3);
 
-  //Force update after sort
-  sorter.changed = true;
+  //Swap in, forces update after sort
+  sorter.publish(loadmutex);
 }
 
 //Reloads triangle indices, required after data update and depth sort
@@ -47,9 +47,28 @@ Triangles::~Triangles()
 void Triangles::close()
 {
   reload = true;
+  adjacency.clear();
   Geometry::close();
 }
 
+void Triangles::clear(bool fixed)
+{
+  Geometry::clear(fixed);
+  pruneAdjacency();
+}
+
+void Triangles::clearStep(int step)
+{
+  Geometry::clearStep(step);
+  pruneAdjacency();
+}
+
+void Triangles::remove(DrawingObject* draw)
+{
+  Geometry::remove(draw);
+  pruneAdjacency();
+}
+
 unsigned int Triangles::triCount(unsigned int index)
 {
   //Get triangle count for element
@@ -231,12 +250,18 @@ void Triangles::loadBuffers()
     if (index > 0)
       geom[index]->voffset = geom[index-1]->voffset + geom[index-1]->count();
     colour.value = 0; //Reset colour
+    //Lookup all the colours required in one pass
+    std::vector<Colour> colours;
+    if (!texmap && (geom[index]->texwidth + geom[index]->texheight == 0) && geom[index]->count())
+    {
+      colours.resize((geom[index]->count()-1) / colrange + 1);
+      getColour.colourise(colours.data(), 0, colours.size());
+    }
     for (unsigned int v=0; v < geom[index]->count(); v++)
     {
       //Have colour values but not enough for per-vertex, spread over range (eg: per triangle)
-      unsigned int cidx = v / colrange;
-      if (!texmap && (geom[index]->texwidth + geom[index]->texheight == 0) && cidx * colrange == v)
-        getColour(colour, cidx);
+      if (colours.size())
+        colour = colours[v / colrange];
 
       float* vert = geom[index]->render->vertices[v];
       if (view->is3d && shift > 0)
@@ -473,49 +498,122 @@ void Triangles::jsonWrite(DrawingObject* draw, json& obj)
   jsonExportAll(draw, obj);
 }
 
+void Triangles::pruneAdjacency()
+{
+  //Discard entries for index data that no longer exists
+  for (auto it = adjacency.begin(); it != adjacency.end(); )
+  {
+    if (it->second.indices.expired())
+      it = adjacency.erase(it);
+    else
+      ++it;
+  }
+}
+
+TriangleAdjacency& Triangles::triangleAdjacency(unsigned int index)
+{
+  UInt_Ptr inds = geom[index]->_indices;
+  unsigned int N = geom[index]->count();
+  pruneAdjacency();
+
+  TriangleAdjacency& adj = adjacency[inds.get()];
+  if (adj.indices.lock() == inds && adj.version == inds->version && adj.vertices == N)
+    return adj;
+
+  clock_t t1,t2;
+  t1 = clock();
+  adj.indices = inds;
+  adj.version = inds->version;
+  adj.vertices = N;
+
+  //Count triangles at each vertex, then fill lists in triangle order
+  std::vector<unsigned int>& indices = inds->value;
+  unsigned int tris = inds->size() / 3;
+  adj.offsets.assign(N+1, 0);
+  for (unsigned int t=0; t<tris; t++)
+  {
+    GLuint* tri = &indices[t*3];
+    if (tri[0] >= N || tri[1] >= N || tri[2] >= N) continue;
+    for (int c=0; c<3; c++)
+      adj.offsets[tri[c]+1]++;
+  }
+  for (unsigned int v=0; v<N; v++)
+    adj.offsets[v+1] += adj.offsets[v];
+
+  std::vector<unsigned int> pos(adj.offsets.begin(), adj.offsets.end()-1);
+  adj.triangles.resize(adj.offsets[N]);
+  for (unsigned int t=0; t<tris; t++)
+  {
+    GLuint* tri = &indices[t*3];
+    if (tri[0] >= N || tri[1] >= N || tri[2] >= N) continue;
+    for (int c=0; c<3; c++)
+      adj.triangles[pos[tri[c]]++] = t;
+  }
+
+  //Count towards geometry memory usage (cache limit)
+  long bytes = (adj.offsets.capacity() + adj.triangles.capacity()) * sizeof(unsigned int);
+  membytes__ += bytes - adj.bytes;
+  adj.bytes = bytes;
+
+  t2 = clock();
+  debug_print("  %.4lf seconds to build vertex adjacency for %d triangles\n", (t2-t1)/(double)CLOCKS_PER_SEC, tris);
+  return adj;
+}
+
 void Triangles::calcTriangleNormals(unsigned int index)
 {
   clock_t t1,t2;
   t1 = clock();
   std::vector<Vec3d> normals(geom[index]->count());
-  Vec3d normal;
+  Coord3DValues& vertices = geom[index]->render->vertices;
+  UIntValues& indices = geom[index]->render->indices;
+  unsigned int N = geom[index]->count();
+  int threads = session.global("threads");
 
   //Has index data, simply load the triangles
-  if (geom[index]->render->indices.size() > 2)
+  if (indices.size() > 2)
   {
-    //TODO: this doesn't appear to be working, normals not smoothed
-    debug_print("Calculating normals (indexed) for triangle surface %d size %d\n", index, geom[index]->render->indices.size()/3);
-    //Calculate face normals for each triangle and copy to each face vertex
-    for (unsigned int i=0; i<geom[index]->render->indices.size()-2 && geom[index]->render->indices.size() > 2; i += 3)
+    debug_print("Calculating normals (indexed) for triangle surface %d size %d\n", index, indices.size()/3);
+    TriangleAdjacency& adj = triangleAdjacency(index);
+
+    //Calculate face normals for each triangle
+    std::vector<Vec3d> faces(indices.size()/3);
+    parallelRange(faces.size(), threads, [&](size_t start, size_t end, unsigned int t)
     {
-      //Copies for each vertex
-      GLuint i1 = geom[index]->render->indices[i];
-      GLuint i2 = geom[index]->render->indices[i+1];
-      GLuint i3 = geom[index]->render->indices[i+2];
-
-      normal = vectorNormalToPlane(geom[index]->render->vertices[i1],
-                                   geom[index]->render->vertices[i2],
-                                   geom[index]->render->vertices[i3]);
-
-      normals[i1] += normal;
-      normals[i2] += normal;
-      normals[i3] += normal;
-    }
+      for (size_t f=start; f<end; f++)
+      {
+        GLuint i1 = indices[f*3];
+        GLuint i2 = indices[f*3+1];
+        GLuint i3 = indices[f*3+2];
+        if (i1 < N && i2 < N && i3 < N)
+          faces[f] = vectorNormalToPlane(vertices[i1], vertices[i2], vertices[i3]);
+      }
+    }, 4096);
+
+    //Sum face normals at each vertex from the adjacency lists, no shared writes between threads
+    parallelRange(normals.size(), threads, [&](size_t start, size_t end, unsigned int t)
+    {
+      for (size_t v=start; v<end; v++)
+      {
+        for (unsigned int j=adj.offsets[v]; j<adj.offsets[v+1]; j++)
+          normals[v] += faces[adj.triangles[j]];
+      }
+    }, 4096);
   }
-  else if (geom[index]->count() > 2)
+  else if (N > 2)
   {
     //Calculate face normals for each triangle and copy to each face vertex
-    debug_print("Calculating normals for triangle surface %d size %d\n", index, geom[index]->count());
-    for (unsigned int v=0; v<geom[index]->count()-2; v += 3)
+    debug_print("Calculating normals for triangle surface %d size %d\n", index, N);
+    parallelRange(N/3, threads, [&](size_t start, size_t end, unsigned int t)
     {
-      //Copies for each vertex
-      normal = vectorNormalToPlane(geom[index]->render->vertices[v],
-                                   geom[index]->render->vertices[v+1],
-                                   geom[index]->render->vertices[v+2]);
-      normals[v] += normal;
-      normals[v+1] += normal;
-      normals[v+2] += normal;
-    }
+      for (size_t f=start; f<end; f++)
+      {
+        unsigned int v = f*3;
+        normals[v] = vectorNormalToPlane(vertices[v], vertices[v+1], vertices[v+2]);
+        normals[v+1] = normals[v];
+        normals[v+2] = normals[v];
+      }
+    }, 4096);
   }
 
   t2 = clock();
@@ -523,15 +621,18 @@ void Triangles::calcTriangleNormals(unsigned int index)
   t1 = clock();
 
   //Normalise to combine and load normal data
-  //geom[index]->render->normals.clear();
-  for (unsigned int n=0; n<normals.size(); n++)
-    normals[n].normalise();
+  parallelRange(normals.size(), threads, [&](size_t start, size_t end, unsigned int t)
+  {
+    for (size_t n=start; n<end; n++)
+      normals[n].normalise();
+  }, 65536);
 
   geom[index]->_normals = std::make_shared<Coord3DValues>();
   read(geom[index], normals.size(), lucNormalData, &normals[0]);
 
   //Update the rendering references as some containers have been replaced
   geom[index]->setRenderData();
+  geom[index]->releaseStore(); //Free the replaced containers
 
   t2 = clock();
   debug_print("  %.4lf seconds to normalise (%d) \n", (t2-t1)/(double)CLOCKS_PER_SEC, (int)normals.size());
@@ -547,70 +648,82 @@ void Triangles::calcGridNormals(unsigned int i)
   bool hasTexture = geom[i]->hasTexture();
   bool genTexCoords = hasTexture && geom[i]->render->texCoords.size() == 0;
   bool flip = geom[i]->draw->properties["flip"];
+  unsigned int width = geom[i]->width;
+  unsigned int height = geom[i]->height;
+  Coord3DValues& vertices = geom[i]->render->vertices;
 
-  // Calc per-vertex normals for irregular meshes by averaging four surrounding triangle facet normals
-  int n = 0;
-  for (unsigned int j = 0 ; j < geom[i]->height; j++ )
+  //Tex coords
+  if (genTexCoords)
   {
-    for (unsigned int k = 0 ; k < geom[i]->width; k++ )
+    std::vector<float> texCoords(width * height * 2);
+    for (unsigned int j = 0 ; j < height; j++ )
     {
-      //Tex coords
-      if (genTexCoords)
+      for (unsigned int k = 0 ; k < width; k++ )
       {
-        float texCoord[2] = {k / (float)(geom[i]->width-1), j / (float)(geom[i]->height-1)};
-        read(geom[i], 1, lucTexCoordData, texCoord);
+        texCoords[(j * width + k) * 2] = k / (float)(width-1);
+        texCoords[(j * width + k) * 2 + 1] = j / (float)(height-1);
       }
+    }
+    read(geom[i], width * height, lucTexCoordData, &texCoords[0]);
+  }
 
-      // Get sum of normal vectors
-      if (j > 0)
+  // Calc per-vertex normals for irregular meshes by averaging four surrounding triangle facet normals
+  // (each vertex only reads neighbouring vertices, so rows are processed in parallel)
+  parallelRange(height, session.global("threads"), [&](size_t start, size_t end, unsigned int t)
+  {
+    for (unsigned int j = start ; j < end; j++ )
+    {
+      for (unsigned int k = 0 ; k < width; k++ )
       {
-        unsigned int j0 = flip ? j-1 : j;
-        unsigned int j1 = flip ? j : j-1;
-        if (k > 0)
+        unsigned int n = j * width + k;
+        // Get sum of normal vectors
+        if (j > 0)
         {
-          // Look back
-          normals[n] += vectorNormalToPlane(geom[i]->render->vertices[geom[i]->width * j0 + k],
-                                            geom[i]->render->vertices[geom[i]->width * j1 + k],
-                                            geom[i]->render->vertices[geom[i]->width * j0 + k-1]);
+          unsigned int j0 = flip ? j-1 : j;
+          unsigned int j1 = flip ? j : j-1;
+          if (k > 0)
+          {
+            // Look back
+            normals[n] += vectorNormalToPlane(vertices[width * j0 + k],
+                                              vertices[width * j1 + k],
+                                              vertices[width * j0 + k-1]);
+          }
+
+          if (k < width - 1)
+          {
+            // Look back in x, forward in y
+            normals[n] += vectorNormalToPlane(vertices[width * j0 + k],
+                                              vertices[width * j0 + k+1],
+                                              vertices[width * j1 + k]);
+          }
         }
 
-        if (k < geom[i]->width - 1)
+        if (j <  height - 1)
         {
-          // Look back in x, forward in y
-          normals[n] += vectorNormalToPlane(geom[i]->render->vertices[geom[i]->width * j0 + k],
-                                            geom[i]->render->vertices[geom[i]->width * j0 + k+1],
-                                            geom[i]->render->vertices[geom[i]->width * j1 + k]);
+          unsigned int j0 = flip ? j+1 : j;
+          unsigned int j1 = flip ? j : j+1;
+          if (k > 0)
+          {
+            // Look forward in x, back in y
+            normals[n] += vectorNormalToPlane(vertices[width * j0 + k],
+                                              vertices[width * j0 + k-1],
+                                              vertices[width * j1 + k]);
+          }
+
+          if (k < width - 1)
+          {
+            // Look forward
+            normals[n] += vectorNormalToPlane(vertices[width * j0 + k],
+                                              vertices[width * j1 + k],
+                                              vertices[width * j0 + k+1]);
+          }
         }
-      }
 
-      if (j <  geom[i]->height - 1)
-      {
-        unsigned int j0 = flip ? j+1 : j;
-        unsigned int j1 = flip ? j : j+1;
-        if (k > 0)
-        {
-          // Look forward in x, back in y
-          normals[n] += vectorNormalToPlane(geom[i]->render->vertices[geom[i]->width * j0 + k],
-                                            geom[i]->render->vertices[geom[i]->width * j0 + k-1],
-                                            geom[i]->render->vertices[geom[i]->width * j1 + k]);
-        }
-
-        if (k < geom[i]->width - 1)
-        {
-          // Look forward
-          normals[n] += vectorNormalToPlane(geom[i]->render->vertices[geom[i]->width * j0 + k],
-                                            geom[i]->render->vertices[geom[i]->width * j1 + k],
-                                            geom[i]->render->vertices[geom[i]->width * j0 + k+1]);
-        }
+        //Normalise to average
+        normals[n].normalise();
       }
-
-      //Normalise to average
-      normals[n].normalise();
-      //Copy directly into normal block
-      //memcpy(geom[i]->render->normals[j * geom[i]->width + k], normal.ref(), sizeof(float) * 3);
-      n++;
     }
-  }
+  }, 64);
   t2 = clock();
   debug_print("  %.4lf seconds\n", (t2-t1)/(double)CLOCKS_PER_SEC);
   t1 = clock();
@@ -619,6 +732,7 @@ void Triangles::calcGridNormals(unsigned int i)
   read(geom[i], normals.size(), lucNormalData, &normals[0]);
   //Update the rendering references as some containers have been replaced
   geom[i]->setRenderData();
+  geom[i]->releaseStore(); //Free the replaced containers
 }
 
 void Triangles::calcGridIndices(unsigned int i)
@@ -705,6 +819,7 @@ void Triangles::calcGridVertices(unsigned int i)
   read(geom[i], vertices.size(), lucVertexData, &vertices[0]);
   //Update the rendering references as some containers have been replaced
   geom[i]->setRenderData();
+  geom[i]->releaseStore(); //Free the replaced containers
 
   t2 = clock();
   debug_print("  %.4lf seconds\n", (t2-t1)/(double)CLOCKS_PER_SEC);
@@ -60,6 +60,115 @@ void abort_program(const char * s, ...)
   throw std::runtime_error(buffer);
 }
 
+unsigned int workerThreads(int threads)
+{
+#if !defined(__EMSCRIPTEN__) || defined(__EMSCRIPTEN_PTHREADS__)
+  if (threads > 0) return threads;
+  unsigned int cores = std::thread::hardware_concurrency();
+  return cores > 0 ? cores : 1;
+#else
+  return 1;
+#endif
+}
+
+BlockPool::~BlockPool()
+{
+  for (auto slab : slabs)
+    delete[] slab;
+}
+
+void* BlockPool::allocate(size_t size)
+{
+  //Keep blocks aligned for any type
+  size = (size + 15) & ~(size_t)15;
+  LOCK_GUARD(mutex);
+  std::vector<void*>& blocks = freed[size];
+  if (blocks.empty())
+  {
+    //Add a new slab and split into blocks
+    char* slab = new char[size * SLAB_BLOCKS];
+    slabs.push_back(slab);
+    for (int i=SLAB_BLOCKS-1; i>=0; i--)
+      blocks.push_back(slab + i * size);
+  }
+  void* ptr = blocks.back();
+  blocks.pop_back();
+  return ptr;
+}
+
+void BlockPool::release(void* ptr, size_t size)
+{
+  size = (size + 15) & ~(size_t)15;
+  LOCK_GUARD(mutex);
+  freed[size].push_back(ptr);
+}
+
+//Reduction over a range of elements, fixed stride so the compiler can vectorise
+template <unsigned int S>
+static void minmaxKernel(const float* data, size_t start, size_t end, float* min, float* max)
+{
+  float mn[S], mx[S];
+  for (unsigned int c=0; c<S; c++)
+  {
+    mn[c] = min[c];
+    mx[c] = max[c];
+  }
+  for (size_t i=start; i<end; i++)
+  {
+    const float* v = data + i*S;
+    //Branch free, invalid elements are replaced by the current min/max
+    bool valid = true;
+    for (unsigned int c=0; c<S; c++)
+      valid &= std::fabs(v[c]) <= FLT_MAX;
+    for (unsigned int c=0; c<S; c++)
+    {
+      float vmin = valid ? v[c] : mn[c];
+      float vmax = valid ? v[c] : mx[c];
+      mn[c] = vmin < mn[c] ? vmin : mn[c];
+      mx[c] = vmax > mx[c] ? vmax : mx[c];
+    }
+  }
+  for (unsigned int c=0; c<S; c++)
+  {
+    min[c] = mn[c];
+    max[c] = mx[c];
+  }
+}
+
+void minmaxReduce(const float* data, size_t N, unsigned int stride, float* min, float* max, int threads)
+{
+  if (stride < 1 || stride > 3)
+    abort_program("Unsupported stride %d for min/max", stride);
+  //Per thread results, initialised with the passed values
+  unsigned int nt = workerThreads(threads);
+  std::vector<float> tmin(nt*stride), tmax(nt*stride);
+  for (unsigned int t=0; t<nt; t++)
+  {
+    std::copy(min, min+stride, &tmin[t*stride]);
+    std::copy(max, max+stride, &tmax[t*stride]);
+  }
+  parallelRange(N, nt, [&](size_t start, size_t end, unsigned int t)
+  {
+    float* mn = &tmin[t*stride];
+    float* mx = &tmax[t*stride];
+    if (stride == 1)
+      minmaxKernel<1>(data, start, end, mn, mx);
+    else if (stride == 2)
+      minmaxKernel<2>(data, start, end, mn, mx);
+    else
+      minmaxKernel<3>(data, start, end, mn, mx);
+  }, 65536);
+  //Combine
+  for (unsigned int t=0; t<nt; t++)
+  {
+    for (unsigned int c=0; c<stride; c++)
+    {
+      if (tmin[t*stride+c] < min[c]) min[c] = tmin[t*stride+c];
+      if (tmax[t*stride+c] > max[c]) max[c] = tmax[t*stride+c];
+    }
+  }
+}
+
 bool FileExists(const std::string& name)
 {
 #if __cplusplus >= 201703L
@@ -155,12 +264,13 @@ bool Range::update(const float& min, const float& max)
   return modified;
 }
 
-void FloatValues::minmax()
+void FloatValues::minmax(int threads)
 {
   if (minimum < maximum) return;
-  auto minmax = std::minmax_element(value.begin(), value.begin()+next);
-  minimum = *minmax.first;
-  maximum = *minmax.second;
+  //Skips nan/inf values
+  minimum = HUGE_VALF;
+  maximum = -HUGE_VALF;
+  minmaxReduce(value.data(), next, 1, &minimum, &maximum, threads);
 }
 
 bool Properties::has(const std::string& key) {return data.count(key) > 0 && !data[key].is_null();}
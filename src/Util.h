@@ -59,6 +59,58 @@
 #define LOCK_GUARD(m) ;
 #endif
 
+//Parallel processing helpers
+//(threads <= 0 uses all available cores, runs in calling thread if single thread or no pthreads support)
+unsigned int workerThreads(int threads=0);
+
+//Process index range [0,N) split into contiguous chunks, one per thread
+// - func(start, end, thread) called with a range and zero based thread index
+// - minchunk sets the smallest range worth starting a thread for
+template <typename Func>
+void parallelRange(size_t N, int threads, Func func, size_t minchunk=1)
+{
+  unsigned int nt = workerThreads(threads);
+  if (minchunk > 1 && N / minchunk < nt) nt = N / minchunk;
+  if (nt <= 1)
+  {
+    if (N > 0) func((size_t)0, N, 0u);
+    return;
+  }
+  size_t chunk = (N + nt - 1) / nt;
+  std::vector<std::thread> workers;
+  for (unsigned int t=1; t<nt && t*chunk < N; t++)
+    workers.push_back(std::thread(func, t*chunk, std::min(N, (t+1)*chunk), t));
+  func((size_t)0, chunk, 0u);
+  for (auto& w : workers)
+    w.join();
+}
+
+//Process N independent tasks of varying cost, each thread takes the next task when done
+// - func(index) called once for each task index
+template <typename Func>
+void parallelTasks(size_t N, int threads, Func func)
+{
+  unsigned int nt = std::min((size_t)workerThreads(threads), N);
+  std::atomic<size_t> next(0);
+  auto worker = [&]()
+  {
+    size_t i;
+    while ((i = next++) < N)
+      func(i);
+  };
+  std::vector<std::thread> workers;
+  for (unsigned int t=1; t<nt; t++)
+    workers.push_back(std::thread(worker));
+  worker();
+  for (auto& w : workers)
+    w.join();
+}
+
+//Min/max reduction over N contiguous elements of stride components (eg: 3 for vertices)
+// - elements with any nan/inf component are skipped
+// - min/max arrays of stride components are updated in place, so can accumulate
+void minmaxReduce(const float* data, size_t N, unsigned int stride, float* min, float* max, int threads=0);
+
 extern FILE* infostream;
 void abort_program(const char * s, ...);
 void debug_print(const char *fmt, ...);
@@ -149,6 +201,39 @@ typedef struct
   int elements;
 } Filter;
 
+//Pool of fixed size blocks carved from larger slabs, for many small objects of a few sizes
+// - freed blocks are kept for reuse, slabs are all released together when the pool is destroyed
+// - allocations made via PoolAllocator hold a reference, so the pool outlives its last block
+class BlockPool
+{
+  std::mutex mutex;
+  std::map<size_t, std::vector<void*> > freed;
+  std::vector<char*> slabs;
+public:
+  static const unsigned int SLAB_BLOCKS = 64;
+
+  ~BlockPool();
+  void* allocate(size_t size);
+  void release(void* ptr, size_t size);
+};
+
+template <typename T>
+class PoolAllocator
+{
+public:
+  typedef T value_type;
+  std::shared_ptr<BlockPool> pool;
+
+  PoolAllocator(std::shared_ptr<BlockPool> pool) : pool(pool) {}
+  template <typename U> PoolAllocator(const PoolAllocator<U>& other) : pool(other.pool) {}
+
+  T* allocate(size_t n) {return (T*)pool->allocate(n * sizeof(T));}
+  void deallocate(T* ptr, size_t n) {pool->release(ptr, n * sizeof(T));}
+
+  template <typename U> bool operator==(const PoolAllocator<U>& other) const {return pool == other.pool;}
+  template <typename U> bool operator!=(const PoolAllocator<U>& other) const {return pool != other.pool;}
+};
+
 //General purpose geometry data store types...
 extern long membytes__;
 extern long mempeak__;
@@ -159,11 +244,12 @@ protected:
   unsigned int next;
 public:
   unsigned int datasize;
+  unsigned int version; //Incremented when data modified
   float minimum;
   float maximum;
   std::string label;
 
-  DataContainer() : next(0), datasize(1), minimum(0), maximum(0), label("") {}
+  DataContainer() : next(0), datasize(1), version(0), minimum(0), maximum(0), label("") {}
 
   //Pure virtual methods
   virtual unsigned int bytes() = 0;
@@ -171,8 +257,16 @@ public:
   virtual void resize(unsigned long size) = 0;
   virtual void clear() = 0;
   virtual void erase(unsigned int start, unsigned int end) = 0;
+  virtual void shrink() = 0;
+  virtual void release() = 0;
   virtual void* ref(unsigned i=0) = 0;
 
+  void reserve(unsigned int n)
+  {
+    //Allocate space for n more data units, before appending in chunks
+    resize(next + n * datasize);
+  }
+
   unsigned int size()
   {
     //Returns size in base data type
@@ -210,15 +304,16 @@ public:
     unsigned int oldsize = value.size();
     if (oldsize < size)
     {
-      //Always at least double size for efficiency when reading 1 value at a time
-      if (n == 1 && size < oldsize*2)
+      //Always at least double size, so appending in chunks of any size takes linear time
+      //(unused space is released by shrink() when data is complete)
+      if (size < oldsize*2)
         size = oldsize*2;
-      else if (n > 1)
-        size = oldsize + n;
       resize(size);
     }
-    memcpy(&value[next], data, n * sizeof(dtype));
+    //(NULL data allocates the space only, to be filled via ref())
+    if (data) memcpy(&value[next], data, n * sizeof(dtype));
     next += n;
+    version++;
   }
 
   inline dtype operator[] (unsigned i)
@@ -252,14 +347,33 @@ public:
     value.clear();
     membytes__ -= sizeof(dtype)*count;
     next = 0;
+    version++;
     //printf("============== MEMORY total %.3f mb, removed %d ==============\n", membytes__/1000000.0f, count);
   }
 
+  void shrink()
+  {
+    //Release allocated space beyond the data read
+    unsigned int oldsize = value.size();
+    if (oldsize <= next) return;
+    value.resize(next);
+    value.shrink_to_fit();
+    membytes__ -= sizeof(dtype)*(oldsize - next);
+  }
+
+  void release()
+  {
+    //Clear and free the allocated space
+    clear();
+    std::vector<dtype>().swap(value);
+  }
+
   void erase(unsigned int start, unsigned int end)
   {
     //erase elements:
     value.erase(value.begin()+start, value.begin()+end);
     membytes__ -= sizeof(dtype)*(end - start);
+    version++;
     //printf("============== MEMORY total %.3f mb, erased %d ==============\n", membytes__/1000000.0f, (end - start));
   }
 };
@@ -270,7 +384,7 @@ class FloatValues : public DataValues<float>
   FloatValues() {}
   void read1(const float& data) {read(1, &data);}
 
-  void minmax();
+  void minmax(int threads=0);
 };
 
 class UIntValues : public DataValues<unsigned int>
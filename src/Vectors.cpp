@@ -64,18 +64,19 @@ void Vectors::update()
     tot += geom[i]->count();
 
     Properties& props = geom[i]->draw->properties;
-    float arrowHead = props["arrowhead"];
-    float normalise = props["normalise"];
-    float vscaling = props["scaling"];
-    float oscaling = props["scalevectors"];
-    float fixedlen = props["length"];
+    const RenderProperties& cprops = geom[i]->draw->compiled();
+    float arrowHead = cprops.arrowhead;
+    float normalise = cprops.normalise;
+    float vscaling = cprops.scaling;
+    float oscaling = cprops.scalevectors;
+    float fixedlen = cprops.length;
 
     //Scale up by factor of model size order of magnitude
     float order = floor(log10(view->model_size));
     order = pow(10,order);
 
     //Dynamic range? Skip if has a fixed scaling property
-    if (props["autoscale"] && vscaling == 1.0)
+    if (cprops.autoscale && vscaling == 1.0)
     {
       //Check has maximum property
       if (props.has("scalemax"))
@@ -104,24 +105,24 @@ void Vectors::update()
     }
 
     //Load scaling factors from properties
-    int quality = 4 * (int)props["glyphs"];
+    int quality = 4 * cprops.glyphs;
     //debug_print("Scaling %f * %f arrowhead %f quality %d\n", vscaling, oscaling, arrowHead, quality);
 
     //Default (0) = automatically calculated radius based on length and "radius" property
-    float radius = props["thickness"];
+    float radius = cprops.thickness;
 
     ColourLookup& getColour = geom[i]->colourCalibrate();
     //Override opacity property temporarily, or will be applied twice
     geom[i]->draw->opacity = 1.0;
     //Skip colour lookups for just colour property, will be applied later
     Colour* cptr = &getColour == &geom[i]->_getColour ? NULL : &colour;
-    bool flat = props["flat"] || quality < 1;
-    bool filter = geom[i]->draw->filterCache.size();
+    bool flat = cprops.flat || quality < 1;
     float scaling = vscaling * oscaling;
     if (scaling <= 0) scaling = 1.0;
-    for (unsigned int v=0; v < geom[i]->count(); v++)
+    //Iterate only the vertices not filtered out
+    for (unsigned int v=geom[i]->unfiltered(0); v < geom[i]->count(); v=geom[i]->unfiltered(v+1))
     {
-      if (!drawable(i) || (filter && geom[i]->filter(v))) continue;
+      if (!drawable(i)) break;
       Vec3d pos(geom[i]->render->vertices[v]);
       Vec3d vec(geom[i]->render->vectors[v]);
       if (cptr) getColour(colour, v);
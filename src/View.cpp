@@ -327,6 +327,35 @@ float View::eyePlaneDistance(const Vec3d& vec)
   return -(modelView[0][2] * vec.x + modelView[1][2] * vec.y + modelView[2][2] * vec.z + modelView[3][2]);
 }
 
+bool View::eyePlaneKeys(const Vec3d* positions, unsigned int count, const float range[2], unsigned short* keys, int threads, const std::atomic<unsigned int>* generation, unsigned int stamp)
+{
+  //Depth sort keys for a contiguous array of positions: distance from the view plane,
+  //clamped to range and scaled to an integer between 0 and USHRT_MAX-1
+  //Returns false if the generation counter moves on from stamp (checked every block of 64k)
+  const float m0 = modelView[0][2], m1 = modelView[1][2], m2 = modelView[2][2], m3 = modelView[3][2];
+  const float min = range[0], max = range[1];
+  const float multiplier = (USHRT_MAX-1.0) / (max - min);
+  const float* pos = &positions[0].x;
+  std::atomic<bool> cancel(false);
+  parallelRange(count, threads, [=, &cancel](size_t start, size_t end, unsigned int t)
+  {
+    for (size_t block=start; block<end && !cancel; block+=65536)
+    {
+      //Kept branch free with locals only so the loop vectorises
+      size_t blockend = std::min(end, block+65536);
+      for (size_t i=block; i<blockend; i++)
+      {
+        float d = -(m0 * pos[i*3] + m1 * pos[i*3+1] + m2 * pos[i*3+2] + m3);
+        d = std::min(max, std::max(min, d));
+        keys[i] = (unsigned short)(multiplier * (d - min));
+      }
+      if (generation && *generation != stamp)
+        cancel = true;
+    }
+  }, 65536);
+  return !cancel;
+}
+
 void View::autoRotate()
 {
   //If model is 2d plane on X or Y axis, rotate to face camera
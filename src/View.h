@@ -162,6 +162,7 @@ public:
   void getMinMaxDistance(float* min, float* max, float range[2], bool eyePlane=false);
   float eyeDistance(const Vec3d& vec);
   float eyePlaneDistance(const Vec3d& vec);
+  bool eyePlaneKeys(const Vec3d* positions, unsigned int count, const float range[2], unsigned short* keys, int threads=0, const std::atomic<unsigned int>* generation=NULL, unsigned int stamp=0);
   void autoRotate();
   std::string rotateString();
   std::string translateString();